@@ -0,0 +1,537 @@
+/*
+   A Scrabble move generator after Appel and Jacobson; see scrabble.h.
+
+     Moves are generated one direction at a time. For down moves we
+   simply transpose the board and generate across moves, then
+   transpose the results back. Within a row, every move must cover an
+   "anchor": an empty square next to a tile (or the center square, on
+   an empty board). For each anchor we build every possible left part
+   of the word, then extend it rightward through the anchor, walking
+   the lexicon as we go. A tile can go on a square only if it also
+   makes a word with the tiles above and below it; those "cross
+   checks" are computed once per square before the search begins.
+*/
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scrabble.h"
+
+#define SCRABBLE_LETTERS 0x3FFFFFFu
+#define SCRABBLE_NONE ((uint32_t)-1)
+
+static const int tile_values[26] = {
+    1, 3, 3, 2, 1, 4, 2, 4, 1, 8, 5, 1, 3,
+    1, 1, 3, 10, 1, 1, 1, 1, 4, 4, 8, 4, 10
+};
+
+/*
+   The premium squares: 'T' triples the word and 'D' doubles it; 't'
+   triples the letter and 'd' doubles it.
+*/
+static const char *premiums[SCRABBLE_SIZE] = {
+    "T..d...T...d..T",
+    ".D...t...t...D.",
+    "..D...d.d...D..",
+    "d..D...d...D..d",
+    "....D.....D....",
+    ".t...t...t...t.",
+    "..d...d.d...d..",
+    "T..d...D...d..T",
+    "..d...d.d...d..",
+    ".t...t...t...t.",
+    "....D.....D....",
+    "d..D...d...D..d",
+    "..D...d.d...D..",
+    ".D...t...t...D.",
+    "T..d...T...d..T",
+};
+
+/*
+   The state of one search, in the orientation being searched: |sq| is
+   the board, transposed if we are looking for down moves. For each
+   empty square, |cross| holds the letters that make a word with the
+   tiles above and below it, and |crossscore| the value of those tiles,
+   or -1 if there are none.
+*/
+struct scrabble_search {
+    const struct scrabble_lexicon *lex;
+    char sq[SCRABBLE_SIZE][SCRABBLE_SIZE];
+    uint32_t cross[SCRABBLE_SIZE][SCRABBLE_SIZE];
+    int crossscore[SCRABBLE_SIZE][SCRABBLE_SIZE];
+    int rack[27];  /* how many of each letter; [26] counts blanks */
+    uint32_t have; /* the letters whose |rack| counts are nonzero */
+    int across;
+    int row, anchor;
+    int start;     /* the column where the word being built begins */
+    char word[SCRABBLE_SIZE+1];
+    unsigned placed;
+    int (*f)(const struct scrabble_move *, void *);
+    void *info;
+    int count;
+    int stop;
+};
+
+/*
+   Without a popcount instruction, GCC's |__builtin_popcount| becomes
+   a library call, which is slower than doing it by hand.
+*/
+static int popcount32(uint32_t x)
+{
+#if defined(__GNUC__) && defined(__POPCNT__)
+    return __builtin_popcount(x);
+#else
+    x = x - ((x >> 1) & 0x55555555u);
+    x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+    x = (x + (x >> 4)) & 0x0F0F0F0Fu;
+    return (x * 0x01010101u) >> 24;
+#endif
+}
+
+static int ctz32(uint32_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(x);
+#else
+    int n = 0;
+    while (!(x & 1)) { x >>= 1; ++n; }
+    return n;
+#endif
+}
+
+/*
+   Take a tile for letter |c| (or a blank, if |c| is 26) from the rack,
+   or put it back.
+*/
+static void take_tile(struct scrabble_search *s, int c)
+{
+    if (--s->rack[c] == 0 && c < 26) s->have &= ~(1u << c);
+}
+
+static void put_tile(struct scrabble_search *s, int c)
+{
+    if (s->rack[c]++ == 0 && c < 26) s->have |= 1u << c;
+}
+
+/* The letters that some tile left in the rack can stand for. */
+static uint32_t playable(const struct scrabble_search *s)
+{
+    return (s->rack[26] > 0)? SCRABBLE_LETTERS: s->have;
+}
+
+/* Follow the edge for letter |c| (0 to 25) out of |node|, if any. */
+static uint32_t lex_step(const struct scrabble_lexicon *lex, uint32_t node, int c)
+{
+    uint32_t ch = lex->nodes[node].children;
+    if (!(ch & (1u << c))) return SCRABBLE_NONE;
+    return lex->nodes[node].first + popcount32(ch & ((1u << c) - 1));
+}
+
+int scrabble_tile_value(int ch)
+{
+    return ('a' <= ch && ch <= 'z')? tile_values[ch - 'a']: 0;
+}
+
+
+/*
+   Building the lexicon. We gather the playable words of every length
+   into one array sorted in dictionary order, so that the words below
+   any node are a contiguous range of it; then each node's children
+   are found by splitting its range on the next letter, and laid out
+   together at the end of the node array.
+*/
+struct lex_word {
+    const char *w;
+    int k;
+};
+
+static int cmp_lex_word(const void *p, const void *q)
+{
+    const struct lex_word *a = p, *b = q;
+    int n = (a->k < b->k)? a->k: b->k;
+    int rc = memcmp(a->w, b->w, n);
+    if (rc != 0) return rc;
+    return a->k - b->k;
+}
+
+static void lex_build(struct scrabble_lexicon *lex, uint32_t node,
+                      const struct lex_word *words, size_t lo, size_t hi,
+                      int depth)
+{
+    struct scrabble_node *n = &lex->nodes[node];
+    size_t i, j;
+    uint32_t child;
+
+    n->children = 0;
+    n->first = lex->len;
+    if (lo < hi && words[lo].k == depth) {
+        n->children |= SCRABBLE_WORD;
+        ++lo;
+    }
+    for (i=lo; i < hi; ++i)
+      n->children |= 1u << (words[i].w[depth] - 'a');
+    lex->len += popcount32(n->children & SCRABBLE_LETTERS);
+    child = n->first;
+    for (i=lo; i < hi; i = j) {
+        for (j=i+1; j < hi && words[j].w[depth] == words[i].w[depth]; ++j) ;
+        lex_build(lex, child++, words, i, j, depth+1);
+    }
+}
+
+static int lex_playable(const char *w, int k)
+{
+    int p;
+    if (k < 2 || k > SCRABBLE_SIZE) return 0;
+    for (p=0; p < k && 'a' <= w[p] && w[p] <= 'z'; ++p) ;
+    return (p == k);
+}
+
+int scrabble_lexicon_init(struct scrabble_lexicon *lex, const struct xdict *d,
+                          const char *const *extra, size_t nextra)
+{
+    struct lex_word *words;
+    size_t n = nextra, nletters = 0;
+    size_t i, j;
+    int k;
+
+    /* The dictionary holds no words shorter than three letters. */
+    for (k=3; k <= SCRABBLE_SIZE && k < XDICT_MAXLENGTH; ++k)
+      n += d->len[k];
+    words = malloc((n+1) * sizeof *words);
+    if (words == NULL) return -3;
+    n = 0;
+    for (k=3; k <= SCRABBLE_SIZE && k < XDICT_MAXLENGTH; ++k) {
+        for (i=0; i < d->len[k]; ++i) {
+            const char *w = xdict_word(d, k, i);
+            if (!lex_playable(w, k)) continue;
+            words[n].w = w;
+            words[n].k = k;
+            ++n;
+        }
+    }
+    for (i=0; i < nextra; ++i) {
+        k = strlen(extra[i]);
+        if (!lex_playable(extra[i], k)) continue;
+        words[n].w = extra[i];
+        words[n].k = k;
+        ++n;
+    }
+    qsort(words, n, sizeof *words, cmp_lex_word);
+    /* A word may be both in the dictionary and among the extras. */
+    for (i=j=0; i < n; ++i) {
+        if (j > 0 && cmp_lex_word(&words[j-1], &words[i]) == 0) continue;
+        words[j++] = words[i];
+        nletters += words[i].k;
+    }
+    n = j;
+
+    /* No trie has more nodes than its words have letters, plus the root. */
+    lex->nodes = malloc((nletters+1) * sizeof *lex->nodes);
+    if (lex->nodes == NULL) {
+        free(words);
+        return -3;
+    }
+    lex->len = 1;
+    lex_build(lex, 0, words, 0, n, 0);
+    free(words);
+    {
+        void *t = realloc(lex->nodes, lex->len * sizeof *lex->nodes);
+        if (t != NULL) lex->nodes = t;
+    }
+    return 0;
+}
+
+void scrabble_lexicon_free(struct scrabble_lexicon *lex)
+{
+    free(lex->nodes);
+    lex->nodes = NULL;
+    lex->len = 0;
+}
+
+
+/* The premium at square (|r|, |c|) of the search's orientation. */
+static int premium_at(const struct scrabble_search *s, int r, int c)
+{
+    return s->across? premiums[r][c]: premiums[c][r];
+}
+
+/*
+   Work out which letters may go on each empty square, given the tiles
+   above and below it: walk the lexicon through the tiles above, then
+   try each letter that can follow, then the tiles below.
+*/
+static void compute_cross_checks(struct scrabble_search *s)
+{
+    const struct scrabble_lexicon *lex = s->lex;
+    int r, c, i;
+    for (r=0; r < SCRABBLE_SIZE; ++r) {
+        for (c=0; c < SCRABBLE_SIZE; ++c) {
+            int top = r, bottom = r+1;
+            uint32_t node = 0, m;
+            int sum = 0;
+            s->cross[r][c] = 0;
+            s->crossscore[r][c] = -1;
+            if (s->sq[r][c] != '.') continue;
+            while (top > 0 && s->sq[top-1][c] != '.') --top;
+            while (bottom < SCRABBLE_SIZE && s->sq[bottom][c] != '.') ++bottom;
+            if (top == r && bottom == r+1) {
+                s->cross[r][c] = SCRABBLE_LETTERS;
+                continue;
+            }
+            for (i=top; i < bottom; ++i)
+              if (i != r) sum += scrabble_tile_value(s->sq[i][c]);
+            s->crossscore[r][c] = sum;
+            for (i=top; i < r && node != SCRABBLE_NONE; ++i)
+              node = lex_step(lex, node, tolower((unsigned char)s->sq[i][c]) - 'a');
+            if (node == SCRABBLE_NONE) continue;
+            for (m = lex->nodes[node].children & SCRABBLE_LETTERS; m != 0; m &= m-1) {
+                int letter = ctz32(m);
+                uint32_t t = lex_step(lex, node, letter);
+                for (i=r+1; i < bottom && t != SCRABBLE_NONE; ++i)
+                  t = lex_step(lex, t, tolower((unsigned char)s->sq[i][c]) - 'a');
+                if (t != SCRABBLE_NONE && (lex->nodes[t].children & SCRABBLE_WORD))
+                  s->cross[r][c] |= 1u << letter;
+            }
+        }
+    }
+}
+
+static int is_anchor(const struct scrabble_search *s, int r, int c)
+{
+    if (s->sq[r][c] != '.') return 0;
+    return (r > 0 && s->sq[r-1][c] != '.') ||
+           (r < SCRABBLE_SIZE-1 && s->sq[r+1][c] != '.') ||
+           (c > 0 && s->sq[r][c-1] != '.') ||
+           (c < SCRABBLE_SIZE-1 && s->sq[r][c+1] != '.');
+}
+
+/*
+   The word in |s->word| runs from column |s->start| up to |end|-1 of
+   row |s->row|. Score it and report it.
+*/
+static void record_move(struct scrabble_search *s, int end)
+{
+    struct scrabble_move mv;
+    int r = s->row;
+    int main = 0, wordmult = 1, cross = 0;
+    int ntiles = 0;
+    int c;
+
+    for (c = s->start; c < end; ++c) {
+        int i = c - s->start;
+        int v = scrabble_tile_value(s->word[i]);
+        if (s->placed & (1u << i)) {
+            int p = premium_at(s, r, c);
+            int lm = (p == 'd')? 2: (p == 't')? 3: 1;
+            int wm = (p == 'D')? 2: (p == 'T')? 3: 1;
+            ++ntiles;
+            v *= lm;
+            wordmult *= wm;
+            if (s->crossscore[r][c] >= 0)
+              cross += (s->crossscore[r][c] + v) * wm;
+        }
+        main += v;
+    }
+    /*
+       A single tile forming words both across and down is found in
+       both passes; keep only the one from the across pass.
+    */
+    if (!s->across && ntiles == 1) {
+        for (c = s->start; !(s->placed & (1u << (c - s->start))); ++c) ;
+        if (s->crossscore[r][c] >= 0) return;
+    }
+
+    mv.across = s->across;
+    mv.row = s->across? r: s->start;
+    mv.col = s->across? s->start: r;
+    memcpy(mv.word, s->word, end - s->start);
+    mv.word[end - s->start] = '\0';
+    mv.placed = s->placed;
+    mv.ntiles = ntiles;
+    mv.score = main * wordmult + cross;
+    if (ntiles == SCRABBLE_RACK)
+      mv.score += SCRABBLE_BINGO;
+    s->count += 1;
+    if (s->f != NULL && s->f(&mv, s->info))
+      s->stop = 1;
+}
+
+/*
+   Extend the word rightward from column |c|, having reached |node| of
+   the lexicon. A word may end at an empty square (or the edge of the
+   board) once it has covered the anchor.
+*/
+static void extend_right(struct scrabble_search *s, uint32_t node, int c)
+{
+    const struct scrabble_lexicon *lex = s->lex;
+    int r = s->row;
+    int i = c - s->start;
+    uint32_t m, t;
+
+    if (s->stop) return;
+    if (c < SCRABBLE_SIZE && s->sq[r][c] != '.') {
+        int ch = s->sq[r][c];
+        t = lex_step(lex, node, tolower(ch) - 'a');
+        if (t != SCRABBLE_NONE) {
+            s->word[i] = ch;
+            extend_right(s, t, c+1);
+        }
+        return;
+    }
+    if (c > s->anchor && (lex->nodes[node].children & SCRABBLE_WORD))
+      record_move(s, c);
+    if (c == SCRABBLE_SIZE) return;
+
+    s->placed |= 1u << i;
+    m = lex->nodes[node].children & s->cross[r][c] & playable(s);
+    for ( ; m != 0; m &= m-1) {
+        int letter = ctz32(m);
+        t = lex_step(lex, node, letter);
+        if (s->rack[letter] > 0) {
+            take_tile(s, letter);
+            s->word[i] = 'a' + letter;
+            extend_right(s, t, c+1);
+            put_tile(s, letter);
+        }
+        if (s->rack[26] > 0) {
+            take_tile(s, 26);
+            s->word[i] = 'A' + letter;
+            extend_right(s, t, c+1);
+            put_tile(s, 26);
+        }
+    }
+    s->placed &= ~(1u << i);
+}
+
+/*
+   Try every left part of up to |limit| tiles, to go on the empty
+   squares just before the anchor, extending each one through it. The
+   left part is the first |len| letters of |s->word|, and has reached
+   |node| of the lexicon. Those squares have no tiles above or below
+   them (or they would be anchors themselves), so any letter will do.
+*/
+static void left_part(struct scrabble_search *s, uint32_t node,
+                      int len, int limit)
+{
+    uint32_t m, t;
+
+    s->start = s->anchor - len;
+    s->placed = (1u << len) - 1;
+    extend_right(s, node, s->anchor);
+    if (len == limit) return;
+
+    m = s->lex->nodes[node].children & playable(s);
+    for ( ; m != 0; m &= m-1) {
+        int letter = ctz32(m);
+        t = lex_step(s->lex, node, letter);
+        if (s->rack[letter] > 0) {
+            take_tile(s, letter);
+            s->word[len] = 'a' + letter;
+            left_part(s, t, len+1, limit);
+            put_tile(s, letter);
+        }
+        if (s->rack[26] > 0) {
+            take_tile(s, 26);
+            s->word[len] = 'A' + letter;
+            left_part(s, t, len+1, limit);
+            put_tile(s, 26);
+        }
+    }
+}
+
+/*
+   If the square before the anchor holds a tile, the left part is
+   already on the board: it is the whole run of tiles ending there.
+   Otherwise it may take any of the empty squares back to the previous
+   anchor, but no more than there are tiles in the rack.
+*/
+static void search_rows(struct scrabble_search *s)
+{
+    int empty = 1;
+    int ntiles = 0;
+    int r, c, i;
+
+    for (i=0; i < 27; ++i)
+      ntiles += s->rack[i];
+    for (r=0; r < SCRABBLE_SIZE; ++r)
+      for (c=0; c < SCRABBLE_SIZE; ++c)
+        if (s->sq[r][c] != '.') empty = 0;
+
+    for (r=0; r < SCRABBLE_SIZE && !s->stop; ++r) {
+        for (c=0; c < SCRABBLE_SIZE && !s->stop; ++c) {
+            if (empty? (r != SCRABBLE_SIZE/2 || c != SCRABBLE_SIZE/2):
+                       !is_anchor(s, r, c))
+              continue;
+            s->row = r;
+            s->anchor = c;
+            if (c > 0 && s->sq[r][c-1] != '.') {
+                uint32_t node = 0;
+                for (i=c; i > 0 && s->sq[r][i-1] != '.'; --i) ;
+                s->start = i;
+                s->placed = 0;
+                for ( ; i < c && node != SCRABBLE_NONE; ++i) {
+                    s->word[i - s->start] = s->sq[r][i];
+                    node = lex_step(s->lex, node, tolower((unsigned char)s->sq[r][i]) - 'a');
+                }
+                if (node != SCRABBLE_NONE)
+                  extend_right(s, node, c);
+            }
+            else {
+                int limit = 0;
+                for (i=c-1; i >= 0 && limit < ntiles-1 && !is_anchor(s, r, i); --i)
+                  ++limit;
+                left_part(s, 0, 0, limit);
+            }
+        }
+    }
+}
+
+int scrabble_generate(const struct scrabble_lexicon *lex,
+                      const char *board, const char *rack,
+                      int (*f)(const struct scrabble_move *, void *),
+                      void *info)
+{
+    struct scrabble_search *s = malloc(sizeof *s);
+    int r, c, n;
+
+    if (s == NULL) return -3;
+    memset(s->rack, 0, sizeof s->rack);
+    for (n=0; rack[n] != '\0'; ++n) {
+        if (rack[n] == '?') s->rack[26] += 1;
+        else if ('a' <= rack[n] && rack[n] <= 'z') s->rack[rack[n] - 'a'] += 1;
+        else break;
+    }
+    if (rack[n] != '\0' || n > SCRABBLE_RACK) {
+        free(s);
+        return -1;
+    }
+    s->have = 0;
+    for (c=0; c < 26; ++c)
+      if (s->rack[c] > 0) s->have |= 1u << c;
+    for (r=0; r < SCRABBLE_SIZE; ++r) {
+        for (c=0; c < SCRABBLE_SIZE; ++c) {
+            int ch = board[r*SCRABBLE_SIZE + c];
+            if (ch != '.' && !isalpha(ch)) {
+                free(s);
+                return -1;
+            }
+        }
+    }
+    s->lex = lex;
+    s->f = f;
+    s->info = info;
+    s->count = 0;
+    s->stop = 0;
+
+    for (s->across = 1; s->across >= 0 && !s->stop; --s->across) {
+        for (r=0; r < SCRABBLE_SIZE; ++r)
+          for (c=0; c < SCRABBLE_SIZE; ++c)
+            s->sq[r][c] = s->across? board[r*SCRABBLE_SIZE + c]:
+                                     board[c*SCRABBLE_SIZE + r];
+        compute_cross_checks(s);
+        search_rows(s);
+    }
+    n = s->count;
+    free(s);
+    return n;
+}
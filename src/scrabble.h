@@ -0,0 +1,102 @@
+/*
+   This library generates every legal Scrabble move for a given board
+   and rack, using the anchor-and-cross-check method of Andrew Appel
+   and Guy Jacobson, "The World's Fastest Scrabble Program" (CACM,
+   May 1988).
+
+     The words come from an ordinary |struct xdict|, but the generator
+   walks its own compact trie, the "lexicon", which is built once by
+   |scrabble_lexicon_init| and can then serve any number of positions.
+   Only words made entirely of the letters a-z are playable. A |struct
+   xdict| holds no words shorter than three letters, so the two-letter
+   words, without which a parallel play is never legal, must be given
+   to |scrabble_lexicon_init| separately.
+*/
+
+#ifndef H_SCRABBLE
+ #define H_SCRABBLE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "xdictlib.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SCRABBLE_SIZE 15   /* the board is 15 squares on a side */
+#define SCRABBLE_RACK 7    /* playing this many tiles earns a bonus */
+#define SCRABBLE_BINGO 50
+
+/*
+   Each node of the lexicon has a bit in |children| for each letter
+   that can follow it, and the child for the lowest such letter is at
+   |first|, with the others following it in letter order. The
+   |SCRABBLE_WORD| bit marks a node at which a word ends. The root is
+   node 0.
+*/
+#define SCRABBLE_WORD 0x4000000u
+
+struct scrabble_node {
+    uint32_t children;
+    uint32_t first;
+};
+
+struct scrabble_lexicon {
+    struct scrabble_node *nodes;
+    size_t len;
+};
+
+/*
+   A move places tiles in a line starting at square (|row|, |col|),
+   reading across or down. |word| is the whole word formed along that
+   line, with uppercase letters standing for blanks; bit |i| of
+   |placed| is set if its |i|th letter is a tile from the rack, rather
+   than one already on the board. |score| includes any cross words
+   formed and the bonus for playing the whole rack.
+*/
+struct scrabble_move {
+    int row, col;
+    int across;
+    char word[SCRABBLE_SIZE+1];
+    unsigned placed;
+    int ntiles;
+    int score;
+};
+
+/*
+   Build the lexicon from the words of |d| and the |nextra| words of
+   |extra|, which may be as short as two letters. Returns 0 on success,
+   or -3 if we run out of memory.
+*/
+int scrabble_lexicon_init(struct scrabble_lexicon *lex, const struct xdict *d,
+                          const char *const *extra, size_t nextra);
+void scrabble_lexicon_free(struct scrabble_lexicon *lex);
+
+/*
+   The board is |SCRABBLE_SIZE| rows of |SCRABBLE_SIZE| characters,
+   one row after another: '.' for an empty square, a lowercase letter
+   for a tile, and an uppercase letter for a blank standing for that
+   letter. The rack is up to |SCRABBLE_RACK| lowercase letters, with
+   '?' for a blank. On an empty board, the first move must cover the
+   center square.
+
+     The callback |f| is called for each legal move; if it returns
+   nonzero, the search stops. |scrabble_generate| returns the number
+   of moves found, -1 if the board or rack is malformed, or -3 if we
+   run out of memory. A move placing a single tile is reported only
+   once, even if it forms words in both directions.
+*/
+int scrabble_generate(const struct scrabble_lexicon *lex,
+                      const char *board, const char *rack,
+                      int (*f)(const struct scrabble_move *, void *),
+                      void *info);
+
+/* Return the score of the tile showing |ch|: zero for a blank. */
+int scrabble_tile_value(int ch);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
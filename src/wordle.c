@@ -0,0 +1,354 @@
+/*
+   A Wordle engine; see wordle.h.
+
+     Everything the solver needs to know about a guess is which
+   "bucket" of feedback each possible answer would put it in, so we
+   compute the feedback for every (guess, answer) pair once, up front,
+   into a table of one-byte codes. Ranking the guesses against the
+   answers that remain is then a matter of counting codes. Both jobs
+   are split among threads a chunk of guesses at a time.
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef XDICT_NO_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+#include "wordle.h"
+
+#define WORDLE_LETTERS 0x3FFFFFFu
+#define WORDLE_CHUNK 64  /* guesses per unit of work */
+
+
+static int wordle_is_word(const char *w)
+{
+    int i;
+    for (i=0; i < WORDLE_LENGTH; ++i)
+      if (w[i] < 'a' || w[i] > 'z') return 0;
+    return 1;
+}
+
+/*
+   Bit |j| of |where[c]| is set if the answer's |j|th letter is letter
+   |c|, so that the squares of the answer matching each letter of the
+   guess take just one lookup. Greens first; then each other letter of
+   the guess, from left to right, is yellow if it matches a letter of
+   the answer not already claimed by a green or an earlier yellow.
+*/
+static int wordle_code(const char *guess, const unsigned char *where)
+{
+    static const int pow3[WORDLE_LENGTH] = { 1, 3, 9, 27, 81 };
+    unsigned eq[WORDLE_LENGTH];
+    unsigned used = 0;
+    int i, code = 0;
+    for (i=0; i < WORDLE_LENGTH; ++i) {
+        eq[i] = where[guess[i] - 'a'];
+        if (eq[i] & (1u << i)) {
+            used |= 1u << i;
+            code += WORDLE_GREEN * pow3[i];
+        }
+    }
+    for (i=0; i < WORDLE_LENGTH; ++i) {
+        unsigned avail = eq[i] & ~used;
+        if (avail != 0 && !(eq[i] & (1u << i))) {
+            used |= avail & -avail;
+            code += WORDLE_YELLOW * pow3[i];
+        }
+    }
+    return code;
+}
+
+static void wordle_where(const char *target, unsigned char *where)
+{
+    int j;
+    memset(where, 0, 26);
+    for (j=0; j < WORDLE_LENGTH; ++j)
+      where[target[j] - 'a'] |= 1u << j;
+}
+
+int wordle_feedback(const char *guess, const char *target)
+{
+    unsigned char where[26];
+    wordle_where(target, where);
+    return wordle_code(guess, where);
+}
+
+int wordle_parse_feedback(const char *s)
+{
+    int i, code = 0;
+    if (strlen(s) != WORDLE_LENGTH) return -1;
+    for (i = WORDLE_LENGTH; i-- > 0; ) {
+        int st;
+        switch (s[i]) {
+            case 'g': case 'G': st = WORDLE_GREEN; break;
+            case 'y': case 'Y': st = WORDLE_YELLOW; break;
+            case '.': case '-': st = WORDLE_GRAY; break;
+            default: return -1;
+        }
+        code = 3*code + st;
+    }
+    return code;
+}
+
+void wordle_format_feedback(int code, char *buf)
+{
+    int i;
+    for (i=0; i < WORDLE_LENGTH; ++i, code /= 3)
+      buf[i] = ".yg"[code % 3];
+    buf[i] = '\0';
+}
+
+
+void wordle_constraint_init(struct wordle_constraint *c)
+{
+    int i;
+    for (i=0; i < WORDLE_LENGTH; ++i)
+      c->allowed[i] = WORDLE_LETTERS;
+    memset(c->mincount, 0, sizeof c->mincount);
+    memset(c->maxcount, WORDLE_LENGTH, sizeof c->maxcount);
+}
+
+/*
+   A green pins its square to its letter, and a yellow or gray rules
+   its letter out of its square. The greens and yellows for a letter
+   give a lower bound on how many times it appears; a gray for it as
+   well means that bound is exact.
+*/
+int wordle_constrain(struct wordle_constraint *c, const char *guess, int code)
+{
+    int seen[26] = {0};
+    int gray[26] = {0};
+    int i;
+
+    if (!wordle_is_word(guess) || code < 0 || code >= WORDLE_CODES)
+      return -1;
+    for (i=0; i < WORDLE_LENGTH; ++i, code /= 3) {
+        int ch = guess[i] - 'a';
+        if (code % 3 == WORDLE_GREEN) {
+            c->allowed[i] &= 1u << ch;
+            seen[ch] += 1;
+        } else {
+            c->allowed[i] &= ~(1u << ch);
+            if (code % 3 == WORDLE_YELLOW) seen[ch] += 1;
+            else gray[ch] = 1;
+        }
+    }
+    for (i=0; i < 26; ++i) {
+        if (c->mincount[i] < seen[i]) c->mincount[i] = seen[i];
+        if (gray[i] && c->maxcount[i] > seen[i]) c->maxcount[i] = seen[i];
+    }
+    return 0;
+}
+
+int wordle_allows(const struct wordle_constraint *c, const char *word)
+{
+    int count[26] = {0};
+    int i;
+    for (i=0; i < WORDLE_LENGTH; ++i) {
+        int ch = word[i] - 'a';
+        if (!(c->allowed[i] & (1u << ch))) return 0;
+        count[ch] += 1;
+    }
+    for (i=0; i < 26; ++i)
+      if (count[i] < c->mincount[i] || count[i] > c->maxcount[i]) return 0;
+    return 1;
+}
+
+size_t wordle_filter(const struct wordle *w, const struct wordle_constraint *c,
+                     size_t *remaining)
+{
+    size_t t, n = 0;
+    for (t=0; t < w->ntargets; ++t)
+      if (wordle_allows(c, w->words[t])) remaining[n++] = t;
+    return n;
+}
+
+
+/*
+   A job is either filling in the table (when |ranks| is NULL) or
+   ranking the guesses; each thread claims the next chunk of guesses.
+*/
+struct wordle_job {
+    struct wordle *w;
+    unsigned char (*where)[26];  /* for each answer; see |wordle_code| */
+    const size_t *remaining;
+    size_t n;
+    struct wordle_rank *ranks;
+    size_t next;
+#ifndef XDICT_NO_THREADS
+    pthread_mutex_t lock;
+#endif
+};
+
+static void wordle_fill_rows(struct wordle_job *job, size_t lo, size_t hi)
+{
+    struct wordle *w = job->w;
+    size_t g, t;
+    for (g=lo; g < hi; ++g) {
+        unsigned char *row = &w->codes[g * w->ntargets];
+        for (t=0; t < w->ntargets; ++t)
+          row[t] = wordle_code(w->words[g], job->where[t]);
+    }
+}
+
+/*
+   Guess |g| splits the |n| answers into buckets by feedback; if the
+   buckets hold c_1, c_2, ... answers, its expected information is
+   log2(n) - sum(c_i log2 c_i)/n bits. It can be the answer exactly
+   when some answer would give it five greens.
+*/
+static void wordle_rank_rows(struct wordle_job *job, size_t lo, size_t hi)
+{
+    const struct wordle *w = job->w;
+    double logn = log2((double)job->n);
+    size_t g, i;
+    for (g=lo; g < hi; ++g) {
+        const unsigned char *row = &w->codes[g * w->ntargets];
+        unsigned count[WORDLE_CODES] = {0};
+        double sum = 0;
+        int code;
+        for (i=0; i < job->n; ++i)
+          count[row[job->remaining[i]]] += 1;
+        for (code=0; code < WORDLE_CODES; ++code)
+          if (count[code] > 1) sum += count[code] * log2((double)count[code]);
+        job->ranks[g].guess = g;
+        job->ranks[g].entropy = (job->n == 0)? 0: logn - sum / job->n;
+        job->ranks[g].candidate = (count[WORDLE_SOLVED] != 0);
+    }
+}
+
+static void *wordle_worker(void *p)
+{
+    struct wordle_job *job = p;
+    for (;;) {
+        size_t lo, hi;
+#ifndef XDICT_NO_THREADS
+        pthread_mutex_lock(&job->lock);
+#endif
+        lo = job->next;
+        hi = (job->w->nwords - lo > WORDLE_CHUNK)? lo + WORDLE_CHUNK: job->w->nwords;
+        job->next = hi;
+#ifndef XDICT_NO_THREADS
+        pthread_mutex_unlock(&job->lock);
+#endif
+        if (lo == hi) return NULL;
+        if (job->ranks == NULL)
+          wordle_fill_rows(job, lo, hi);
+        else
+          wordle_rank_rows(job, lo, hi);
+    }
+}
+
+static void wordle_run(struct wordle_job *job)
+{
+#ifndef XDICT_NO_THREADS
+    pthread_t tids[64];
+    int nthreads = 0;
+    int nchunks = (job->w->nwords + WORDLE_CHUNK-1) / WORDLE_CHUNK;
+#endif
+    job->next = 0;
+#ifndef XDICT_NO_THREADS
+    pthread_mutex_init(&job->lock, NULL);
+    while (nthreads < job->w->threads-1 && nthreads < nchunks-1 &&
+           nthreads < (int)(sizeof tids / sizeof *tids)) {
+        if (pthread_create(&tids[nthreads], NULL, wordle_worker, job) != 0)
+          break;
+        ++nthreads;
+    }
+#endif
+    wordle_worker(job);
+#ifndef XDICT_NO_THREADS
+    while (nthreads > 0)
+      pthread_join(tids[--nthreads], NULL);
+    pthread_mutex_destroy(&job->lock);
+#endif
+}
+
+
+int wordle_init(struct wordle *w, struct xdict *targets,
+                struct xdict *guesses, int threads)
+{
+    struct wordle_job job;
+    size_t n = targets->len[WORDLE_LENGTH];
+    size_t i;
+
+#if !defined(XDICT_NO_THREADS) && defined(_SC_NPROCESSORS_ONLN)
+    if (threads == 0)
+      threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    w->threads = (threads < 1)? 1: threads;
+    w->nwords = w->ntargets = 0;
+    w->codes = NULL;
+    if (guesses != NULL) n += guesses->len[WORDLE_LENGTH];
+    w->words = malloc((n+1) * sizeof *w->words);
+    if (w->words == NULL) return -3;
+
+    for (i=0; i < targets->len[WORDLE_LENGTH]; ++i) {
+        const char *word = xdict_word(targets, WORDLE_LENGTH, i);
+        if (!wordle_is_word(word)) continue;
+        memcpy(w->words[w->nwords], word, WORDLE_LENGTH);
+        w->words[w->nwords++][WORDLE_LENGTH] = '\0';
+    }
+    w->ntargets = w->nwords;
+    for (i=0; guesses != NULL && i < guesses->len[WORDLE_LENGTH]; ++i) {
+        const char *word = xdict_word(guesses, WORDLE_LENGTH, i);
+        if (!wordle_is_word(word)) continue;
+        if (xdict_contains(targets, word, WORDLE_LENGTH)) continue;
+        memcpy(w->words[w->nwords], word, WORDLE_LENGTH);
+        w->words[w->nwords++][WORDLE_LENGTH] = '\0';
+    }
+    if (w->ntargets == 0) {
+        wordle_free(w);
+        return -1;
+    }
+
+    w->codes = malloc(w->nwords * w->ntargets);
+    job.where = malloc(w->ntargets * sizeof *job.where);
+    if (w->codes == NULL || job.where == NULL) {
+        free(job.where);
+        wordle_free(w);
+        return -3;
+    }
+    for (i=0; i < w->ntargets; ++i)
+      wordle_where(w->words[i], job.where[i]);
+    job.w = w;
+    job.ranks = NULL;
+    wordle_run(&job);
+    free(job.where);
+    return 0;
+}
+
+void wordle_free(struct wordle *w)
+{
+    free(w->words);
+    free(w->codes);
+    w->words = NULL;
+    w->codes = NULL;
+    w->nwords = w->ntargets = 0;
+}
+
+
+static int wordle_cmp_rank(const void *p, const void *q)
+{
+    const struct wordle_rank *a = p, *b = q;
+    if (a->entropy != b->entropy) return (a->entropy < b->entropy)? 1: -1;
+    if (a->candidate != b->candidate) return b->candidate - a->candidate;
+    return (a->guess < b->guess)? -1: (a->guess > b->guess);
+}
+
+void wordle_rank(const struct wordle *w, const size_t *remaining, size_t n,
+                 struct wordle_rank *ranks)
+{
+    struct wordle_job job;
+    job.w = (struct wordle *)w;
+    job.where = NULL;
+    job.remaining = remaining;
+    job.n = n;
+    job.ranks = ranks;
+    wordle_run(&job);
+    qsort(ranks, w->nwords, sizeof *ranks, wordle_cmp_rank);
+}
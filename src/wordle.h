@@ -0,0 +1,116 @@
+/*
+   This library plays Wordle: it works out the feedback a guess gets,
+   narrows down the possible answers given the feedback so far, and
+   ranks the next guesses by how much they are expected to tell us.
+
+     A feedback is packed into a single "code" from 0 to 242, with
+   three states per letter: |WORDLE_GRAY| (the letter is not in the
+   answer, or not that many times), |WORDLE_YELLOW| (it is, but
+   elsewhere), and |WORDLE_GREEN| (it is in the right place). The
+   state of letter |i| is the |i|th base-3 digit of the code, counting
+   from the least significant.
+*/
+
+#ifndef H_WORDLE
+ #define H_WORDLE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "xdictlib.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WORDLE_LENGTH 5
+#define WORDLE_CODES 243     /* 3 to the power |WORDLE_LENGTH| */
+#define WORDLE_SOLVED 242    /* the code for five greens */
+
+#define WORDLE_GRAY 0
+#define WORDLE_YELLOW 1
+#define WORDLE_GREEN 2
+
+/*
+   What the feedback so far says about the answer: bit |c| of
+   |allowed[i]| is set if letter |c| ('a' is 0) may be the |i|th letter,
+   and the answer holds between |mincount[c]| and |maxcount[c]| copies
+   of letter |c|.
+*/
+struct wordle_constraint {
+    uint32_t allowed[WORDLE_LENGTH];
+    unsigned char mincount[26];
+    unsigned char maxcount[26];
+};
+
+/*
+   The guesses are |words[0]| to |words[nwords-1]|, of which the first
+   |ntargets| are the possible answers. |codes[g*ntargets + t]| is the
+   feedback that guess |g| would get if the answer were |words[t]|.
+*/
+struct wordle {
+    char (*words)[WORDLE_LENGTH+1];
+    size_t nwords, ntargets;
+    unsigned char *codes;
+    int threads;
+};
+
+struct wordle_rank {
+    size_t guess;      /* an index into |words| */
+    double entropy;    /* the expected information, in bits */
+    int candidate;     /* nonzero if the guess could be the answer */
+};
+
+/*
+   Build the feedback table, using up to |threads| threads (zero means
+   one per processor). The answers are the five-letter words of
+   |targets|; the guesses are those and the other five-letter words of
+   |guesses|, which may be NULL. Words containing anything but the
+   letters a-z are skipped. Returns 0 on success, -1 if there are no
+   answers, or -3 if we run out of memory.
+*/
+int wordle_init(struct wordle *w, struct xdict *targets,
+                struct xdict *guesses, int threads);
+void wordle_free(struct wordle *w);
+
+/* Return the code for |guess| if the answer is |target|. */
+int wordle_feedback(const char *guess, const char *target);
+
+/*
+   A feedback is written as five characters: 'g' for green, 'y' for
+   yellow, and '.' or '-' for gray. |wordle_parse_feedback| returns
+   the code, or -1 if the string is malformed; |wordle_format_feedback|
+   writes the string and its terminating null into |buf|.
+*/
+int wordle_parse_feedback(const char *s);
+void wordle_format_feedback(int code, char *buf);
+
+/*
+   Start with no constraints, and then narrow them by the feedback
+   |code| for |guess|; |wordle_constrain| returns -1 if the guess is
+   not five letters a-z or the code is out of range.
+*/
+void wordle_constraint_init(struct wordle_constraint *c);
+int wordle_constrain(struct wordle_constraint *c, const char *guess, int code);
+int wordle_allows(const struct wordle_constraint *c, const char *word);
+
+/*
+   Store in |remaining| the index of each answer that |c| allows, and
+   return how many there are. |remaining| must have room for
+   |w->ntargets| entries.
+*/
+size_t wordle_filter(const struct wordle *w, const struct wordle_constraint *c,
+                     size_t *remaining);
+
+/*
+   Rank every guess against the |n| answers listed in |remaining|,
+   filling |ranks| (which must have room for |w->nwords| entries) best
+   first: by entropy, then preferring guesses that could be the answer.
+*/
+void wordle_rank(const struct wordle *w, const size_t *remaining, size_t n,
+                 struct wordle_rank *ranks);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -11,6 +11,15 @@
 /* The text file where the dictionary is stored */
 #define XDICT_SAVE_TXT "xdict.save.txt"
 
+/* The journal of edits made since that file was last written */
+#define XDICT_SAVE_JNL "xdict.save.jnl"
+
+/* How much memory to spend remembering the results of recent searches */
+#define SEARCH_CACHE_BYTES (4L << 20)
+
+/* How many matches to show at once; MORE shows the next batch */
+#define PAGE_WORDS 300
+
 /*
    Define this macro if the operating system will free our memory on exit;
    otherwise it may take a long time for the program to free individually
@@ -24,20 +33,31 @@
 int printme(const char *s, void *info_dummy);
 void engraveme(void);
 int display_set(const char *s, void *info);
+int print_ladder(const char *s, void *info);
+int show_page(struct xdict_cursor *c);
+void journal(int op, const char *text);
+int compact(struct xdict *d);
 void do_error(const char *fmt, ...);
 void do_help(void);
 void do_man(int page_height);
  void page(const char *s);
 
+/* Set if an edit couldn't be appended to the journal */
+static int glob_journal_failed = 0;
+
 
 int main(void)
 {
     struct xdict dict;
     int modified = 0;
+    int minscore = 0;
+    struct xdict_cursor results;
+    int results_total = 0;
     char cmd[100];
     int rc;
 
     xdict_init(&dict);
+    xdict_set_threads(&dict, 0);
     puts("Inited successfully");
     switch (rc = xdict_load(&dict, XDICT_SAVE_TXT)) {
         case -1: do_error("Dictionary not found");
@@ -45,6 +65,23 @@ int main(void)
         case -3: do_error("Out of memory");
         case -4: do_error("Out of memory");
     }
+    switch (rc = xdict_replay_journal(&dict, XDICT_SAVE_JNL)) {
+        case -1: break;
+        case -2: puts("Journal corrupted; replayed only the edits before it");
+                 break;
+        default: modified = rc;
+                 if (rc > 0)
+                   printf("Replayed %d edit%s from " XDICT_SAVE_JNL "\n", rc, PLUR(rc));
+                 break;
+        case -3: do_error("Out of memory");
+    }
+    if (xdict_build_index(&dict, XDICT_INDEX_POSITIONS | XDICT_INDEX_COLUMNS |
+                                 XDICT_INDEX_TRIE | XDICT_INDEX_ANAGRAMS |
+                                 XDICT_INDEX_HASH | XDICT_INDEX_LETTERS) != 0)
+      do_error("Out of memory");
+    if (xdict_set_cache(&dict, SEARCH_CACHE_BYTES) != 0)
+      do_error("Out of memory");
+    results.d = NULL;
     puts("Loaded successfully. Type HELP for details.");
 
     while (fgets(cmd, sizeof cmd, stdin) != NULL) {
@@ -66,12 +103,28 @@ int main(void)
                     two_words = 1;
                     strcpy(cmd+end, "s");
                     rc2 = xdict_addword(&dict, cmd+start, end+1-start);
+                    if (rc2 == 0) journal('+', cmd+start);
                 }
             }
-            cmd[end] = '\0';
-            rc = xdict_addword(&dict, cmd+start, end-start);
-            if (!rc || !rc2)
-              modified++;
+            if (cmd[end] == ';') {
+                /* "ADD chortle;60" gives the word a score. */
+                int score = atoi(cmd+end+1);
+                cmd[end] = '\0';
+                rc = xdict_addword_scored(&dict, cmd+start, end-start, score);
+                if (rc == 0) {
+                    sprintf(cmd+end, ";%d", score);
+                    journal('+', cmd+start);
+                }
+            }
+            else {
+                cmd[end] = '\0';
+                rc = xdict_addword(&dict, cmd+start, end-start);
+                if (rc == 0) journal('+', cmd+start);
+            }
+            if (!rc || !rc2) {
+                modified++;
+                xdict_cursor_close(&results);
+            }
             if (!rc && !rc2)
               puts("Added successfully.");
             else if (rc == -3 || rc == -4 || rc2 == -3 || rc2 == -4)
@@ -95,24 +148,30 @@ int main(void)
             else if (rc == 0)  puts("Word not found; continuing.");
             else {
                 puts("Removed successfully.");
+                journal('-', cmd+start);
                 modified++;
+                xdict_cursor_close(&results);
             }
         }
         else if (strncmp(cmd, "SET ", 4) == 0) {
-            int start, end, index = -1;
+            int start, end, pos = 0, index = -1, in_class = 0;
             for (start=4; isspace(cmd[start]); ++start);
             for (end=start; !isspace(cmd[end]); ++end) {
                 if (cmd[end] == '_')
-                  cmd[end] = '?', index = end-start;
+                  cmd[end] = '?', index = pos;
                 else
                   cmd[end] = tolower(cmd[end]);
+                /* A bracketed class such as "[aeiou]" is one position. */
+                if (cmd[end] == '[') in_class = 1;
+                else if (cmd[end] == ']') in_class = 0;
+                if (!in_class) ++pos;
             }
             cmd[end] = '\0';
             if (index < 0) {
                 puts("Set action requires a '_' marker!");
             }
             else {
-                rc = xdict_find(&dict, cmd+start, display_set, &index);
+                rc = xdict_find_min(&dict, cmd+start, minscore, display_set, &index);
                 if (rc < 0)  puts("Set action failed; continuing.");
                 else if (rc == 0)  puts("No matching words found; continuing.");
                 else  display_set(NULL, NULL);
@@ -152,10 +211,113 @@ int main(void)
                 engraveme(); printf("%d\n", rc);
             }
         }
+        else if (strncmp(cmd, "COUNT ", 6) == 0) {
+            int start, end;
+            for (start=6; isspace(cmd[start]); ++start);
+            for (end=start; !isspace(cmd[end]); ++end)
+              cmd[end] = tolower(cmd[end]);
+            cmd[end] = '\0';
+            if (minscore > 0)
+              rc = xdict_find_min(&dict, cmd+start, minscore, NULL, NULL);
+            else
+              rc = xdict_count(&dict, cmd+start);
+            printf("%d\n", rc);
+        }
+        else if (strncmp(cmd, "FUZZY ", 6) == 0) {
+            int start, end, maxdist = 1;
+            for (start=6; isspace(cmd[start]); ++start);
+            for (end=start; isalpha(cmd[end]); ++end)
+              cmd[end] = tolower(cmd[end]);
+            cmd[end] = '\0';
+            while (isspace(cmd[++end])) ;
+            if (isdigit(cmd[end]))
+              maxdist = atoi(cmd+end);
+            if (end == start || maxdist < 1 || maxdist > 3) {
+                puts("Usage: FUZZY word [distance], with a distance from 1 to 3");
+            }
+            else {
+                rc = xdict_find_fuzzy(&dict, cmd+start, maxdist, printme, NULL);
+                engraveme(); printf("%d\n", rc);
+            }
+        }
+        else if (strncmp(cmd, "LETTERS ", 8) == 0) {
+            int start, end;
+            int requiredstart;
+            for (start=8; isspace(cmd[start]); ++start);
+            for (end=start; !isspace(cmd[end]); ++end)
+              cmd[end] = tolower(cmd[end]);
+            cmd[end++] = '\0';
+            for (requiredstart=end; isspace(cmd[requiredstart]); ++requiredstart);
+            for (end=requiredstart; !isspace(cmd[end]) && cmd[end] != '\0'; ++end)
+              cmd[end] = tolower(cmd[end]);
+            cmd[end] = '\0';
+            /* "LETTERS * xyz" lists the words using all of x, y and z. */
+            rc = xdict_find_letterset(&dict,
+                    strcmp(cmd+start, "*")? cmd+start: NULL,
+                    cmd+requiredstart, printme, NULL);
+            if (rc < 0) {
+                puts("Letter sets must be strictly alphabetic!");
+            }
+            else {
+                engraveme(); printf("%d\n", rc);
+            }
+        }
+        else if (strncmp(cmd, "LADDER ", 7) == 0) {
+            char from[XDICT_MAXLENGTH], to[XDICT_MAXLENGTH];
+            int i, maxsteps = 0, shown = 0;
+            int n = sscanf(cmd+7, "%15s %15s %d", from, to, &maxsteps);
+            for (i=0; n >= 2 && from[i] != '\0'; ++i) from[i] = tolower(from[i]);
+            for (i=0; n >= 2 && to[i] != '\0'; ++i) to[i] = tolower(to[i]);
+            /* Without a step limit, show just one shortest ladder. */
+            if (n < 2 || maxsteps < 0)
+              rc = -2;
+            else if (n == 2)
+              rc = xdict_find_ladder(&dict, from, to, print_ladder, &shown);
+            else
+              rc = xdict_find_ladders(&dict, from, to, maxsteps, print_ladder, &shown);
+            if (rc == -2)
+              puts("Usage: LADDER word word [maxsteps]");
+            else if (rc == -1)
+              puts("Both words must be in the dictionary, and the same length!");
+            else if (rc == -3)
+              do_error("Out of memory");
+            else if (n == 2 && rc == 0)
+              puts("No ladder joins them.");
+            else if (n == 3 && shown == PAGE_WORDS)
+              printf("Stopped after %d ladders.\n", PAGE_WORDS);
+            else if (n == 3)
+              printf("%d\n", rc);
+        }
+        else if (strcmp(cmd, "MORE\n") == 0) {
+            if (results.d == NULL || results.pos >= (size_t)results_total) {
+                puts("No more matching words.");
+            }
+            else {
+                int from = results.pos;
+                show_page(&results);
+                printf("%d-%d of %d\n", from+1, (int)results.pos, results_total);
+            }
+        }
         else if (strcmp(cmd, "SORT\n") == 0) {
+            xdict_cursor_close(&results);
             xdict_sort(&dict);
             puts("Done.");
         }
+        else if (strncmp(cmd, "THREADS ", 8) == 0) {
+            int n = atoi(cmd+8);
+            if (n < 1) {
+                puts("Thread count must be a positive number!");
+            }
+            else {
+                xdict_set_threads(&dict, n);
+                printf("Searching with %d thread%s.\n", n, PLUR(n));
+            }
+        }
+        else if (strncmp(cmd, "MINSCORE ", 9) == 0) {
+            minscore = atoi(cmd+9);
+            if (minscore < 0) minscore = 0;
+            printf("Showing words scoring %d or more.\n", minscore);
+        }
         else if (strcmp(cmd, "STAT\n") == 0) {
             int i, total = 0;
             for (i=0; i < XDICT_MAXLENGTH; ++i)
@@ -164,16 +326,20 @@ int main(void)
             printf("Total word count is %d\n", total);
             printf("%d modification%s; %ssorted\n",
                 modified, PLUR(modified), dict.sorted? "": "not ");
+            if (minscore > 0)
+              printf("Showing only words scoring %d or more\n", minscore);
+            printf("Search cache: %lu hit%s, %lu miss%s\n",
+                dict.cache_hits, PLUR(dict.cache_hits),
+                dict.cache_misses, (dict.cache_misses == 1)? "": "es");
         }
-        else if (strcmp(cmd, "SAVE\n") == 0) {
-            if (!dict.sorted) {
-                puts("Sorting dictionary...");
-                xdict_sort(&dict);
-            }
-            if (xdict_save(&dict, XDICT_SAVE_TXT))
+        else if (!strcmp(cmd, "SAVE\n") || !strcmp(cmd, "COMPACT\n")) {
+            xdict_cursor_close(&results);
+            if (compact(&dict) != 0)
               puts("Dictionary not saved");
-            puts("Saved successfully.");
-            modified = 0;
+            else {
+                puts("Saved successfully.");
+                modified = 0;
+            }
         }
         else if (!strcmp(cmd, "QUIT\n") || !strcmp(cmd, "EXIT\n")) {
             break;
@@ -210,23 +376,42 @@ int main(void)
             for (end=start; !isspace(cmd[end]); ++end)
               cmd[end] = tolower(cmd[end]);
             cmd[end] = '\0';
-            rc = xdict_find(&dict, cmd+start, printme, NULL);
-            engraveme(); printf("%d\n", rc);
+            /*
+               Show only the first page of matches; the cursor stays
+               open so that MORE can pick up where this page ended.
+            */
+            xdict_cursor_close(&results);
+            rc = xdict_cursor_open(&results, &dict, cmd+start, minscore);
+            if (rc > 0) {
+                results_total = rc;
+                show_page(&results);
+            }
+            else {
+                xdict_cursor_close(&results);
+                engraveme();
+            }
+            printf("%d\n", rc);
+            if (results.d != NULL && results.pos < (size_t)rc)
+              printf("Showing the first %d; type MORE for the rest.\n", (int)results.pos);
         next_loop: ;
         }
     }
 
+    /*
+       Every edit is already in the journal, unless appending to it
+       failed; only then must we rewrite the whole dictionary.
+    */
     puts("Wait...");
-    if (modified > 0) {
+    if (modified > 0 && glob_journal_failed) {
         printf("%d modification%s\n", modified, PLUR(modified));
-        if (!dict.sorted) {
-            puts("Sorting dictionary...");
-            xdict_sort(&dict);
-        }
-        if (xdict_save(&dict, XDICT_SAVE_TXT))
+        if (compact(&dict) != 0)
           do_error("Dictionary not saved");
         puts("Saved successfully");
     }
+    else if (modified > 0) {
+        printf("%d modification%s kept in " XDICT_SAVE_JNL "\n",
+            modified, PLUR(modified));
+    }
 #if FAST_EXIT
 #else
     puts("Freeing memory...");
@@ -309,6 +494,58 @@ void engraveme(void)
 }
 
 
+/*
+   Append an edit to the journal, so that it survives even if the
+   program never gets to rewrite the dictionary file.
+*/
+void journal(int op, const char *text)
+{
+    if (xdict_append_journal(XDICT_SAVE_JNL, op, text) != 0 &&
+            !glob_journal_failed) {
+        puts("Couldn't write to " XDICT_SAVE_JNL "; the dictionary will be saved on exit.");
+        glob_journal_failed = 1;
+    }
+}
+
+/*
+   Fold the journal into the dictionary file by rewriting the whole
+   file. The journal is removed only once the new file is in place;
+   if we crash in between, replaying it again does no harm.
+*/
+int compact(struct xdict *d)
+{
+    if (!d->sorted) {
+        puts("Sorting dictionary...");
+        xdict_sort(d);
+    }
+    if (xdict_save(d, XDICT_SAVE_TXT) != 0)
+      return -1;
+    remove(XDICT_SAVE_JNL);
+    glob_journal_failed = 0;
+    return 0;
+}
+
+
+/* Print the next page of matches from |c|, returning how many there were. */
+int show_page(struct xdict_cursor *c)
+{
+    static char buf[PAGE_WORDS][XDICT_MAXLENGTH];
+    int i, n = xdict_cursor_next(c, buf, PAGE_WORDS);
+    for (i=0; i < n; ++i)
+      printme(buf[i], NULL);
+    engraveme();
+    return n;
+}
+
+
+/* Print each ladder on its own line, stopping after a page of them. */
+int print_ladder(const char *s, void *info)
+{
+    int *shown = info;
+    puts(s);
+    return ++*shown >= PAGE_WORDS;
+}
+
 int display_set(const char *s, void *info)
 {
     static char buf[CHAR_MAX-CHAR_MIN] = {0};
@@ -348,19 +585,30 @@ void do_help(void)
     puts("HELP          This message");
     puts("HELP VERBOSE  Complete man pages for xdict");
     puts("QUIT, EXIT    (Save and) exit, the same as Ctrl-D");
-    puts("SAVE          Save the word list into " XDICT_SAVE_TXT);
+    puts("COMPACT, SAVE Rewrite " XDICT_SAVE_TXT " with the journaled edits");
     puts("SORT          Sort the dictionary");
     puts("STAT          Display some statistical details");
+    puts("THREADS 4     Search the dictionary using 4 threads");
+    puts("MINSCORE 50   Show only words scoring 50 or more");
     puts("ch0rtl*       Display matching word(s)");
     puts("SET ch_rtl*   Display set of crossing letters");
+    puts("COUNT ch0rtl* Display only the number of matching words");
+    puts("MORE          Display the next page of matching words");
     puts("RACK cehlortz Show plays for the given Scrabble rack");
+    puts("FUZZY chortle 2  Show words within 2 edits of \"chortle\"");
+    puts("LETTERS aehlrst h  Show words using only those letters, including h");
+    puts("LADDER cold warm  Show a shortest word ladder from \"cold\" to \"warm\"");
+    puts("LADDER cold warm 5  Show every ladder of at most 5 steps");
     puts("ADD chortle   Add a word to the dictionary");
+    puts("ADD chortle;60  Add a word with a score (or set its score)");
     puts("REM ch0rtl*   Remove word(s) from the dictionary");
     puts("");
     puts("set           Matches the word \"set\" only");
     puts("b0g           Vowel: matches bag, beg, big,... but not bfg");
     puts("do1           Consonant: matches doc, dog, don,... but not doe");
     puts("do?           Single letter: matches doc, doe, dog,...");
+    puts("d[io]g        Class: matches dig, dog but not dug");
+    puts("do[^cg]       Negated class: matches doe, don,... but not doc, dog");
     puts("do*t          Any string: matches dot, doubt, donut,...");
 }
 
@@ -377,25 +625,31 @@ void do_man(int page_height)
     page("  The 'xdict' utility is a crossword dictionary. It supports");
     page("various kinds of wildcard searches, including restricting");
     page("the wildcards to vowels or consonants.");
-    glob_paralines = 4;
+    glob_paralines = 9;
     page("  The word list for the dictionary is stored in the text file");
     page("'" XDICT_SAVE_TXT "'. That file is just a list of words: one");
     page("word per line. Words must be completely alphabetic, and can't");
     page("have any embedded spaces; capitalization is irrelevant.");
+    page("A word may be followed by a semicolon and a score from 0 to 255,");
+    page("as in \"chortle;60\"; words without one score 50.");
+    page("The file may instead be a binary dictionary from 'xdict-compile',");
+    page("which loads much faster, or a smaller one from 'xdict-compile");
+    page("--compress'; COMPACT always writes the text format.");
     glob_paralines = 10;
-    page("  The user meta-command SAVE saves the word list back to that");
-    page("file. It will sort the dictionary first, if needed.");
-    page("  When the program exits normally --- upon encountering the");
-    page("end-of-file marker or one of the user meta-commands QUIT and EXIT");
-    page("--- it will check to see whether the dictionary has been modified");
-    page("by any ADD or REM commands since the last time it was saved. If");
-    page("the word list has been modified, then it will sort the list and");
-    page("save it. If the word list is unmodified, the program will free");
-    page("its resources and exit without performing the redundant save");
-    page("operation.");
-    glob_paralines = 2;
+    page("  Each ADD or REM command is appended at once to the journal file");
+    page("'" XDICT_SAVE_JNL "', which is replayed over the word list the");
+    page("next time the program starts; so edits are never lost, and");
+    page("saving one doesn't mean rewriting the whole word list. The user");
+    page("meta-command COMPACT (or SAVE) sorts the dictionary, writes it");
+    page("back to '" XDICT_SAVE_TXT "' and removes the journal. The file is");
+    page("written under a temporary name and then renamed into place, so");
+    page("a crash partway through leaves the old file intact. When the");
+    page("program exits --- at end-of-file or upon QUIT or EXIT --- the");
+    page("journal is left for next time.");
+    glob_paralines = 3;
     page("  The user meta-command STAT can be used to see whether the");
-    page("dictionary has been modified, and whether it is currently sorted.");
+    page("dictionary has been modified, whether it is currently sorted, and");
+    page("how many searches were answered from the cache of recent results.");
     glob_paralines = 6;
     page("  The meta-command SET is used to find out quickly which letters");
     page("can be used in a given position. For example, searching on the");
@@ -403,14 +657,51 @@ void do_man(int page_height)
     page("therefore the meta-command 'SET be??_f' yields the three letters");
     page("\"elo\", and 'SET be_??f' yields \"hl\". All the normal wildcards");
     page("can be used in SET commands.");
+    glob_paralines = 3;
+    page("  A search displays at most 300 words at a time. When there");
+    page("are more, the meta-command MORE displays the next batch, picking");
+    page("up where the last one stopped.");
+    glob_paralines = 2;
+    page("  The meta-command COUNT prints just the number of words matching");
+    page("a pattern, which is faster than listing them: 'COUNT be???f'.");
     glob_paralines = 7;
-    page("  The meta-command RACK is used to find out (slowly) what words");
+    page("  The meta-command RACK is used to find out what words");
     page("can be created from the given set of letters, as in Scrabble (but");
     page("using the whole word list, not just Scrabble dictionary words).");
     page("For example, the pattern 'abcde' yields \"cab\", \"bead\", and so");
     page("on. The wildcard '?' can be used to indicate a blank tile; for");
     page("example, the pattern 'abc?e' yields \"crab\" but not \"crabs\".");
     page("The wildcard '*' cannot be used in RACK commands.");
+    glob_paralines = 6;
+    page("  The meta-command LETTERS lists the words made only of the given");
+    page("letters, each used any number of times: 'LETTERS aehlrst' yields");
+    page("\"halters\" and \"shelters\". Letters after a space must all appear,");
+    page("so 'LETTERS aehlrst h' leaves out \"slaters\"; and 'LETTERS * xyz'");
+    page("lists the words that use all of x, y and z, together with any");
+    page("other letters.");
+    glob_paralines = 4;
+    page("  The meta-command FUZZY finds near misses: 'FUZZY chortle 2'");
+    page("shows the words that can be made from \"chortle\" by inserting,");
+    page("deleting or changing at most two letters, such as \"chortles\"");
+    page("and \"shortly\". The distance may be 1 (the default), 2 or 3.");
+    glob_paralines = 6;
+    page("  The meta-command LADDER builds word ladders, changing one letter");
+    page("at a time: 'LADDER cold warm' shows a shortest ladder, such as");
+    page("\"cold cord card ward warm\". With a number of steps after the two");
+    page("words, as in 'LADDER cold warm 5', it shows every ladder that long");
+    page("or shorter that doesn't use a word twice (300 at most). Both words");
+    page("must be in the dictionary.");
+    glob_paralines = 5;
+    page("  Besides '?', '0', '1' and '*', a pattern may contain a class of");
+    page("letters in square brackets, such as 'd[io]g', which matches \"dig\"");
+    page("and \"dog\". A class beginning with '^' matches any letter except");
+    page("those listed: 'do[^cg]' matches \"doe\" but not \"dog\". Classes");
+    page("may include the '0' and '1' wildcards, as in '[0s]'.");
+    glob_paralines = 4;
+    page("  The meta-command MINSCORE hides low-scoring words: after");
+    page("'MINSCORE 50', searches and SET commands consider only the words");
+    page("scoring 50 or more. 'MINSCORE 0' shows every word again.");
+    page("'ADD chortle;60' adds \"chortle\" with a score of 60.");
     glob_paralines = 3;
     page("  All the normal wildcards can be used in REM commands, also;");
     page("the command 'REM foo*' will remove \"food\" and \"footstool\".");
@@ -1,325 +1,3528 @@
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <ctype.h>
+#include <limits.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef XDICT_NO_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifndef XDICT_NO_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+#ifndef XDICT_NO_FSYNC
+#include <unistd.h>
+#endif
 #include "xdictlib.h"
 
+/*
+   The columnar scan has SSE2 and AVX2 kernels, chosen at runtime, when
+   compiling with GCC or Clang for x86. Elsewhere it is never used.
+*/
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(XDICT_NO_SIMD)
+ #define XDICT_SIMD 1
+ #include <immintrin.h>
+#else
+ #define XDICT_SIMD 0
+#endif
+
 #define is_consonant(k) (strchr("bcdfghjklmnpqrstvwxyz",k) != NULL)
 #define is_vowel(k) (strchr("aeiouy",k) != NULL)
 
 /*
-   For the time being, the |xdict| data is stored to disk as a single
-   gigantic text file, containing all the words in the dictionary in
-   plain text separated by newlines.
+   The binary format begins with a header: the magic number, a version
+   number, a word of flags, and then for each word length |k| the number
+   of words of that length and the file offset at which they begin. All
+   numbers are 32-bit little-endian. Each length's words follow, sorted
+   and without duplicates, stored back to back just as in memory, and
+   then their scores, one byte each. This lets |xdict_open_mapped| serve
+   queries directly from the file. Version 1 files have no flags and no
+   scores.
+*/
+#define XDICT_BIN_MAGIC "XDICTBIN"
+#define XDICT_BIN_MAGICLEN 8
+#define XDICT_BIN_VERSION 2
+#define XDICT_BIN_SCORED 0x1  /* flag: the scores were given explicitly */
+#define XDICT_BIN_HEADERLEN (XDICT_BIN_MAGICLEN + 8 + 8*XDICT_MAXLENGTH)
+#define XDICT_BIN_V1_HEADERLEN (XDICT_BIN_MAGICLEN + 4 + 8*XDICT_MAXLENGTH)
+
+/*
+   The compressed format is front-coded. After the magic number, the
+   version and the flags come the restart interval |R| and then, for
+   each word length |k|, the number of words and the offset of that
+   length's section. A section holds a table of 32-bit offsets, one per
+   block of |R| words, then the words, then (if the scores were given
+   explicitly) one score byte per word. The first word of each block is
+   stored whole; each of the others as one byte giving how many leading
+   characters it shares with the word before it, then the rest of its
+   characters. A reader can start decoding at any block.
+*/
+#define XDICT_FC_MAGIC "XDICTFC1"
+#define XDICT_FC_VERSION 1
+#define XDICT_FC_RESTART 16
+#define XDICT_FC_HEADERLEN (XDICT_BIN_MAGICLEN + 12 + 8*XDICT_MAXLENGTH)
+
+#define XDICT_MAXLINE 34  /* see |xdict_load| */
+
+static int xdict_own_bucket(struct xdict *d, int k);
+static int xdict_grow_bucket(struct xdict *d, int k, size_t want);
+static void xdict_touch(struct xdict *d, int k);
+static void xdict_free_byscore(struct xdict_byscore *x);
+static void xdict_free_lettersets(struct xdict_lettersets *x);
+static int xdict_popcount64(uint64_t x);
+static void xdict_cache_drop(struct xdict *d, int k);
+static int xdict_load_binary(struct xdict *d, const char *fname);
+static int xdict_write_binary(void *info, FILE *out);
+static int xdict_write_compressed(void *info, FILE *out);
+static int xdict_load_compressed(struct xdict *d, const unsigned char *buf,
+                                 size_t n);
+static int xdict_add(struct xdict *d, const char *word, int k, int score);
+
+/* Read the rest of |in| into one buffer, of which |*len| bytes are used. */
+static char *xdict_slurp(FILE *in, size_t *len)
+{
+    size_t n = 0, cap = 4096;
+    long size;
+    char *buf;
+    if (fseek(in, 0, SEEK_END) == 0 && (size = ftell(in)) > 0)
+      cap = size + 1;
+    rewind(in);
+    buf = malloc(cap);
+    if (buf == NULL) return NULL;
+    for (;;) {
+        char *t;
+        n += fread(buf + n, 1, cap - n, in);
+        if (n < cap) break;
+        t = realloc(buf, cap * 2);
+        if (t == NULL) {
+            free(buf);
+            return NULL;
+        }
+        buf = t;
+        cap *= 2;
+    }
+    *len = n;
+    return buf;
+}
+
+/*
+   Split the line |p| of |len| characters into a word and a score, as
+   in "word;60". Set |*wordlen| to the length of the word, and return
+   the score, clamped to the range 0 to |XDICT_MAXSCORE|, or -1 if the
+   line gives none.
+*/
+static int xdict_parse_line(const char *p, size_t len, size_t *wordlen)
+{
+    const char *semi = memchr(p, ';', len);
+    const char *end = p + len;
+    int score = 0, neg = 0;
+    if (semi == NULL) {
+        *wordlen = len;
+        return -1;
+    }
+    *wordlen = semi - p;
+    for (p = semi+1; p < end && *p == ' '; ++p) ;
+    if (p < end && *p == '-') neg = 1, ++p;
+    for ( ; p < end && isdigit((unsigned char)*p); ++p) {
+        if (score <= XDICT_MAXSCORE)
+          score = 10*score + (*p - '0');
+    }
+    if (neg) return 0;
+    return (score > XDICT_MAXSCORE)? XDICT_MAXSCORE: score;
+}
+
+/*
+   The |xdict| data is normally stored to disk as a single gigantic
+   text file, containing all the words in the dictionary in plain text
+   separated by newlines. Each word may be followed by a semicolon and
+   its score. A file written by |xdict_save_binary| is recognized by its
+   magic number and loaded via |xdict_open_mapped| instead, and one
+   written by |xdict_save_compressed| is decoded.
 */
 int xdict_load(struct xdict *d, const char *fname)
 {
     FILE *in = fopen(fname, "r");
-    char buffer[XDICT_MAXLENGTH+25];
+    size_t count[XDICT_MAXLENGTH] = {0};
+    char magic[XDICT_BIN_MAGICLEN];
+    size_t n;
+    char *buf, *p, *end;
     int rc = 0;
+    int k;
     if (in == NULL)  return -1;
-    while (fgets(buffer, (sizeof buffer)-5, in) != NULL) {
-        char *p = strchr(buffer, '\n');
-        int rc;
-        if (p == NULL)  { rc = -2; goto done; }
-        *p = '\0';
-        rc = xdict_addword(d, buffer, p - buffer);
-        if (rc < -1) goto done;
+    /* A binary file is mapped, not read; look at its magic number first. */
+    if (fread(magic, 1, sizeof magic, in) == sizeof magic &&
+        memcmp(magic, XDICT_BIN_MAGIC, XDICT_BIN_MAGICLEN) == 0) {
+        fclose(in);
+        return xdict_load_binary(d, fname);
     }
-  done:
+    rewind(in);
+    buf = xdict_slurp(in, &n);
     fclose(in);
+    if (buf == NULL)  return -3;
+    if (n >= XDICT_BIN_MAGICLEN &&
+        memcmp(buf, XDICT_FC_MAGIC, XDICT_BIN_MAGICLEN) == 0) {
+        int rc = xdict_load_compressed(d, (unsigned char *)buf, n);
+        free(buf);
+        return rc;
+    }
+
+    /*
+       Count the words of each length first, so that each bucket
+       need only be grown once. Lines that are too long or too short
+       to be words are skipped, as |xdict_addword| would; a line far
+       too long to be a word means the file is corrupted, and we load
+       only what comes before it.
+    */
+    end = buf + n;
+    for (p = buf; p < end; ) {
+        char *q = memchr(p, '\n', end - p);
+        size_t len = (q ? q : end) - p;
+        if (len > XDICT_MAXLINE) {
+            rc = -2;
+            end = p;
+            break;
+        }
+        xdict_parse_line(p, len, &len);
+        if (len > 2 && len < XDICT_MAXLENGTH)
+          count[len] += 1;
+        if (q == NULL) break;
+        p = q+1;
+    }
+    for (k=0; k < XDICT_MAXLENGTH; ++k) {
+        size_t want = d->len[k] + count[k];
+        if (count[k] == 0) continue;
+        if (xdict_own_bucket(d, k) != 0)  { rc = -3; goto done; }
+        xdict_touch(d, k);
+        if (xdict_grow_bucket(d, k, want) != 0)  { rc = -3; goto done; }
+    }
+    for (p = buf; p < end; ) {
+        char *q = memchr(p, '\n', end - p);
+        size_t len = (q ? q : end) - p;
+        int score = xdict_parse_line(p, len, &len);
+        if (len > 2 && len < XDICT_MAXLENGTH) {
+            memcpy(xdict_word(d, len, d->len[len]), p, len);
+            if (score < 0)
+              score = XDICT_DEFAULT_SCORE;
+            else
+              d->scored = 1;
+            d->scores[len][d->len[len]] = score;
+            d->len[len]++;
+            d->sorted = 0;
+        }
+        if (q == NULL) break;
+        p = q+1;
+    }
+  done:
+    free(buf);
     xdict_sort(d);
     return rc;
 }
 
 
-int xdict_save(struct xdict *d, const char *fname)
+static int xdict_write_text(void *info, FILE *out)
 {
-    FILE *out = fopen(fname, "w");
+    struct xdict *d = info;
     size_t i;
     int k;
-    if (out == NULL)  return -1;
     for (k=0; k < XDICT_MAXLENGTH; ++k) {
         for (i=0; i < d->len[k]; ++i) {
-            fprintf(out, "%s\n", d->words[k][i].word);
+            if (d->scored)
+              fprintf(out, "%.*s;%d\n", k, xdict_word(d, k, i), xdict_score(d, k, i));
+            else
+              fprintf(out, "%.*s\n", k, xdict_word(d, k, i));
         }
     }
-    fclose(out);
     return 0;
 }
 
+/*
+   Every file is written to a temporary file which is then renamed
+   over |fname|, so that a crash partway through leaves the old file
+   intact. The new file is synced to the disk before the rename, so
+   that this holds after a power failure too; a system without
+   |fsync| (XDICT_NO_FSYNC) is safe only from crashes of the program.
+   |write| returns 0, or -3 if it runs out of memory; we look for
+   write errors ourselves.
+*/
+static int xdict_write_file(const char *fname,
+                            int (*write)(void *, FILE *), void *info)
+{
+    char *tmp = malloc(strlen(fname) + 5);
+    FILE *out;
+    int rc, bad;
+    if (tmp == NULL)  return -3;
+    sprintf(tmp, "%s.tmp", fname);
+    out = fopen(tmp, "wb");
+    if (out == NULL) {
+        free(tmp);
+        return -1;
+    }
+    rc = write(info, out);
+    bad = ferror(out);
+#ifndef XDICT_NO_FSYNC
+    if (fflush(out) != 0 || fsync(fileno(out)) != 0)
+      bad = 1;
+#endif
+    if (fclose(out) != 0 || bad || rc != 0 || rename(tmp, fname) != 0) {
+        remove(tmp);
+        free(tmp);
+        return (rc != 0)? rc: -1;
+    }
+    free(tmp);
+    return 0;
+}
 
-void xdict_init(struct xdict *d)
+/*
+   Write |d| to |fname| in the format of the file already there: text,
+   unless it is a binary or compressed dictionary, so that a file
+   compiled with |xdict_save_binary| or |xdict_save_compressed| stays
+   that way. Returns 0 on success, -1 if the file can't be written, or
+   -3 if we run out of memory.
+*/
+int xdict_save(struct xdict *d, const char *fname)
 {
-    int k;
-    d->sorted = 1;
-    for (k=0; k < XDICT_MAXLENGTH; ++k) {
-        d->words[k] = NULL;
-        d->len[k] = d->cap[k] = 0;
+    int (*write)(void *, FILE *) = xdict_write_text;
+    char magic[XDICT_BIN_MAGICLEN];
+    FILE *in = fopen(fname, "rb");
+    if (in != NULL) {
+        if (fread(magic, 1, sizeof magic, in) == sizeof magic) {
+            if (memcmp(magic, XDICT_BIN_MAGIC, XDICT_BIN_MAGICLEN) == 0)
+              write = xdict_write_binary;
+            else if (memcmp(magic, XDICT_FC_MAGIC, XDICT_BIN_MAGICLEN) == 0)
+              write = xdict_write_compressed;
+        }
+        fclose(in);
     }
+    return xdict_write_file(fname, write, d);
 }
 
 
-static int xdict_sortcmp(const void *p, const void *q)
+/* The first |len| bytes of a journal, for |xdict_write_file|. */
+struct xdict_prefix {
+    const char *buf;
+    size_t len;
+};
+
+static int xdict_write_prefix(void *info, FILE *out)
 {
-    const struct word_entry *wp = p;
-    const struct word_entry *wq = q;
-    return strcmp(wp->word, wq->word);
+    struct xdict_prefix *p = info;
+    fwrite(p->buf, 1, p->len, out);
+    return 0;
 }
 
-void xdict_sort(struct xdict *d)
+/*
+   If a crash cut short the last line of the journal |fname|, cut it
+   off, so that the next edit doesn't run on from it. That's rare, and
+   so we just rewrite the rest of the journal. Returns 0, or -1 if the
+   journal can't be mended.
+*/
+static int xdict_mend_journal(const char *fname)
 {
-    int k;
-    for (k=0; k < XDICT_MAXLENGTH; ++k) {
-        size_t i, n = d->len[k];
-        struct word_entry *w = d->words[k];
-        if (n < 2) continue;
-        qsort(w, n, sizeof *w, xdict_sortcmp);
-        /* Remove duplicates. */
-        for (i=n; i > 1; --i) {
-            if (strcmp(w[i-1].word, w[i-2].word) == 0) {
-                if (i < --n)
-                  memcpy(w[i-1].word, w[n].word, k);
-            }
+    FILE *in = fopen(fname, "rb");
+    struct xdict_prefix p;
+    char *buf;
+    size_t n;
+    int rc;
+    if (in == NULL)  return 0;
+    if (fseek(in, -1, SEEK_END) != 0 || getc(in) == '\n') {
+        fclose(in);
+        return 0;
+    }
+    rewind(in);
+    buf = xdict_slurp(in, &n);
+    fclose(in);
+    if (buf == NULL)  return -1;
+    for (p.len = n; p.len > 0 && buf[p.len-1] != '\n'; --p.len) ;
+    p.buf = buf;
+    rc = xdict_write_file(fname, xdict_write_prefix, &p);
+    free(buf);
+    return (rc != 0)? -1: 0;
+}
+
+/*
+   A journal records the edits made to a dictionary since its file was
+   last written, so that saving an edit costs one short append rather
+   than rewriting the whole file. Each line is "+word" or "+word;score"
+   for a word added, or "-pattern" for the words matching a pattern
+   removed. Replaying an edit twice does no harm, so the journal can
+   safely be removed after the dictionary file has been rewritten.
+*/
+int xdict_append_journal(const char *fname, int op, const char *text)
+{
+    FILE *out;
+    int bad;
+    if (xdict_mend_journal(fname) != 0)  return -1;
+    out = fopen(fname, "a");
+    if (out == NULL)  return -1;
+    fprintf(out, "%c%s\n", op, text);
+    bad = ferror(out);
+    if (fclose(out) != 0 || bad)  return -1;
+    return 0;
+}
+
+/*
+   Apply the edits in the journal |fname| to |d|, returning how many
+   there were, or -1 if there is no journal. A last line without its
+   newline was cut short by a crash while being appended, and is
+   ignored; any other malformed line, including a word added that
+   isn't all lowercase letters, means the journal is corrupted, and we
+   return -2 after applying only the edits before it.
+*/
+int xdict_replay_journal(struct xdict *d, const char *fname)
+{
+    FILE *in = fopen(fname, "r");
+    size_t n;
+    char *buf, *p, *q, *end;
+    int count = 0;
+    int rc = 0;
+    if (in == NULL)  return -1;
+    buf = xdict_slurp(in, &n);
+    fclose(in);
+    if (buf == NULL)  return -3;
+    end = buf + n;
+    for (p = buf; (q = memchr(p, '\n', end - p)) != NULL; p = q+1) {
+        size_t len = q - p;
+        if (len < 2 || (*p != '+' && *p != '-')) {
+            rc = -2;
+            break;
         }
-        if (n < d->len[k]) {
-            d->len[k] = n;
-            qsort(w, n, sizeof *w, xdict_sortcmp);
+        *q = '\0';
+        if (*p == '-') {
+            rc = xdict_remmatch(d, p+1, 0);
+        }
+        else {
+            int score = xdict_parse_line(p+1, len-1, &len);
+            size_t i;
+            for (i=0; i < len && 'a' <= p[1+i] && p[1+i] <= 'z'; ++i) ;
+            if (i < len) {
+                rc = -2;
+                break;
+            }
+            p[1+len] = '\0';
+            if (score < 0)
+              rc = xdict_addword(d, p+1, len);
+            else
+              rc = xdict_addword_scored(d, p+1, len, score);
         }
+        if (rc == -3)  break;
+        rc = 0;
+        ++count;
     }
-    d->sorted = 1;
+    free(buf);
+    return (rc < 0)? rc: count;
 }
 
 
-void xdict_free(struct xdict *d)
+static void put32(unsigned char *p, unsigned long x)
 {
-    size_t i, k;
-    for (k=0; k < XDICT_MAXLENGTH; ++k) {
-        for (i=0; i < d->len[k]; ++i)
-          free(d->words[k][i].word);
-        free(d->words[k]);
-    }
+    p[0] = x & 0xFF; p[1] = (x >> 8) & 0xFF;
+    p[2] = (x >> 16) & 0xFF; p[3] = (x >> 24) & 0xFF;
 }
 
+static unsigned long get32(const unsigned char *p)
+{
+    return p[0] | ((unsigned long)p[1] << 8) |
+        ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
 
-int xdict_addword(struct xdict *d, const char *word, int k)
+static int xdict_write_binary(void *info, FILE *out)
 {
-    char *tmp;
-    if (k == 0) k = strlen(word);
-    if (k >= XDICT_MAXLENGTH) return -1;
-    if (k <= 2) return -1;
-    if (d->len[k] >= d->cap[k]) {
-        size_t newcap = d->cap[k] * 2 + 15;
-        void *t = realloc(d->words[k], newcap * sizeof *d->words[k]);
-        if (t == NULL) return -3;
-        d->words[k] = t;
-        d->cap[k] = newcap;
+    struct xdict *d = info;
+    unsigned char header[XDICT_BIN_HEADERLEN];
+    unsigned long offset = XDICT_BIN_HEADERLEN;
+    int k;
+
+    if (!d->sorted)
+      xdict_sort(d);
+    memcpy(header, XDICT_BIN_MAGIC, XDICT_BIN_MAGICLEN);
+    put32(header + XDICT_BIN_MAGICLEN, XDICT_BIN_VERSION);
+    put32(header + XDICT_BIN_MAGICLEN + 4, d->scored? XDICT_BIN_SCORED: 0);
+    for (k=0; k < XDICT_MAXLENGTH; ++k) {
+        unsigned char *p = header + XDICT_BIN_MAGICLEN + 8 + 8*k;
+        put32(p, d->len[k]);
+        put32(p+4, offset);
+        offset += d->len[k] * (k+1);
+    }
+
+    fwrite(header, 1, sizeof header, out);
+    for (k=0; k < XDICT_MAXLENGTH; ++k) {
+        size_t i;
+        if (d->len[k] == 0) continue;
+        fwrite(d->words[k], k, d->len[k], out);
+        if (d->scores[k] != NULL)
+          fwrite(d->scores[k], 1, d->len[k], out);
+        else for (i=0; i < d->len[k]; ++i)
+          putc(XDICT_DEFAULT_SCORE, out);
     }
-    tmp = malloc(k+1);
-    if (tmp == NULL) return -4;
-    memcpy(tmp, word, k); tmp[k] = '\0';
-    d->words[k][d->len[k]++].word = tmp;
-    d->sorted = 0;
     return 0;
 }
 
-
-int xdict_remword(struct xdict *d, const char *word, int k)
+/*
+   Write |d| to |fname| in the binary format described at the top of
+   this file, sorting it first if need be. Returns 0 on success, -1 if
+   the file can't be written, or -3 if we run out of memory.
+*/
+int xdict_save_binary(struct xdict *d, const char *fname)
 {
-    int count = 0;
-    struct word_entry *w;
-    size_t i;
+    return xdict_write_file(fname, xdict_write_binary, d);
+}
 
-    if (k == 0) k = strlen(word);
-    if (k >= XDICT_MAXLENGTH) return -1;
-    if (k <= 2) return -1;
-    w = d->words[k];
-    for (i=0; i < d->len[k]; ++i) {
-        if (memcmp(w[i].word, word, k) == 0) {
-            d->len[k]--;
-            if (i != d->len[k]) {
-                strcpy(w[i].word, w[d->len[k]].word);
-                d->sorted = 0;
-            }
-            free(w[d->len[k]].word);
-            ++count;
-        }
-    }
-    return count;
+
+static void xdict_unmap(struct xdict *d)
+{
+    if (d->map == NULL) return;
+#ifndef XDICT_NO_MMAP
+    munmap(d->map, d->maplen);
+#else
+    free(d->map);
+#endif
+    d->map = NULL;
+    d->maplen = 0;
 }
 
+/*
+   Map the binary dictionary file |fname| read-only into memory, and
+   point each of |d|'s length buckets directly into the mapping. No
+   words are copied; a bucket is copied into the heap only when the
+   client modifies it. Without |mmap| (that is, if |XDICT_NO_MMAP| is
+   defined) we read the whole file into one block instead.
 
-int xdict_remmatch(struct xdict *d, const char *pat, int k)
+     |d| must be empty, as from |xdict_init|: we return -1 rather than
+   overwrite its words or an earlier mapping. The header is checked in
+   full before any bucket is set, so that a bad file leaves |d| empty.
+*/
+int xdict_open_mapped(struct xdict *d, const char *fname)
 {
-    if (k != 0 && strchr(pat, '*') == NULL) {
-        if (strchr(pat, '?') == NULL)
-          return xdict_remword(d, pat, k);
-        else {
-            int count = 0;
-            struct word_entry *w;
-            size_t i;
-            if (k == 0) k = strlen(pat);
-            if (k >= XDICT_MAXLENGTH) return -1;
-            if (k <= 2) return -1;
-            w = d->words[k];
-            for (i=0; i < d->len[k]; ++i) {
-                if (xdict_match(w[i].word, pat)) {
-                    d->len[k]--;
-                    if (i != d->len[k]) {
-                        strcpy(w[i].word, w[d->len[k]].word);
-                        d->sorted = 0;
-                    }
-                    free(w[d->len[k]].word);
-                    ++count;
-                }
-            }
-            return count;
-        }
+    const unsigned char *base, *table;
+    unsigned long version;
+    size_t size;
+    int k;
+
+    if (d->map != NULL) return -1;
+    for (k=0; k < XDICT_MAXLENGTH; ++k)
+      if (d->len[k] != 0 || d->cap[k] != 0) return -1;
+
+#ifndef XDICT_NO_MMAP
+    struct stat st;
+    void *map;
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0)  return -1;
+    if (fstat(fd, &st) != 0) { close(fd); return -1; }
+    size = st.st_size;
+    if (size < XDICT_BIN_V1_HEADERLEN) { close(fd); return -2; }
+    map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)  return -3;
+#else
+    void *map;
+    long fsize;
+    FILE *in = fopen(fname, "rb");
+    if (in == NULL)  return -1;
+    if (fseek(in, 0, SEEK_END) != 0 || (fsize = ftell(in)) < 0) {
+        fclose(in);
+        return -1;
     }
-    else {
-        /*
-           The pattern does contain a '*' wildcard, and the client
-           has not specified a word length.  We must check all possible
-           word lengths.
-        */
-        int count = 0;
-        size_t i;
-        for (i=k=0; pat[i]; ++i)
-          if (pat[i] != '*') ++k;
-        for ( ; k < XDICT_MAXLENGTH; ++k)
-        {
-            struct word_entry *w = d->words[k];
-            for (i=0; i < d->len[k]; ++i) {
-                if (xdict_match(w[i].word, pat)) {
-                    d->len[k]--;
-                    if (i != d->len[k]) {
-                        strcpy(w[i].word, w[d->len[k]].word);
-                        d->sorted = 0;
-                    }
-                    free(w[d->len[k]].word);
-                    ++count;
-                }
-            }
+    size = fsize;
+    if (size < XDICT_BIN_V1_HEADERLEN) { fclose(in); return -2; }
+    map = malloc(size);
+    if (map == NULL) { fclose(in); return -3; }
+    rewind(in);
+    if (fread(map, 1, size, in) != size) {
+        free(map);
+        fclose(in);
+        return -2;
+    }
+    fclose(in);
+#endif
+    d->map = map;
+    d->maplen = size;
+    base = map;
+
+    version = get32(base + XDICT_BIN_MAGICLEN);
+    if (memcmp(base, XDICT_BIN_MAGIC, XDICT_BIN_MAGICLEN) != 0 ||
+        version < 1 || version > XDICT_BIN_VERSION ||
+        (version > 1 && size < XDICT_BIN_HEADERLEN)) {
+        xdict_unmap(d);
+        return -2;
+    }
+    table = base + XDICT_BIN_MAGICLEN + 4;
+    if (version > 1)
+      table += 4;
+    for (k=0; k < XDICT_MAXLENGTH; ++k) {
+        const unsigned char *p = table + 8*k;
+        size_t n = get32(p);
+        size_t offset = get32(p+4);
+        size_t stride = (version > 1)? k+1: k;
+        if (offset > size || (stride > 0 && n > (size - offset) / stride)) {
+            xdict_unmap(d);
+            return -2;
         }
-        return count;
     }
+    if (version > 1)
+      d->scored = (get32(table - 4) & XDICT_BIN_SCORED) != 0;
+    for (k=0; k < XDICT_MAXLENGTH; ++k) {
+        const unsigned char *p = table + 8*k;
+        size_t n = get32(p);
+        size_t offset = get32(p+4);
+        xdict_touch(d, k);
+        d->words[k] = (n > 0)? (char *)base + offset: NULL;
+        d->scores[k] = (n > 0 && version > 1)?
+            (unsigned char *)base + offset + n*k: NULL;
+        d->len[k] = n;
+        d->cap[k] = 0;
+    }
+    d->sorted = 1;
+    return 0;
 }
 
-
-int xdict_match(const char *w, const char *p)
+/*
+   |xdict_load| may be asked to load a binary file into a dictionary
+   that already contains words. In that case we can't simply point at
+   the mapping; copy the words over and sort them in.
+*/
+static int xdict_load_binary(struct xdict *d, const char *fname)
 {
-    int i, j;
-    for (i=0; p[i]; ++i) {
-        if (p[i] == '*') {
-            for (j=i; w[j]; ++j)
-              if (xdict_match(w+j, p+i+1)) return 1;
-            if (xdict_match(w+j, p+i+1)) return 1;
-            return 0;
+    struct xdict tmp;
+    size_t i;
+    int k, rc;
+
+    for (k=0; k < XDICT_MAXLENGTH; ++k) {
+        if (d->len[k] > 0 || d->cap[k] != 0 || d->map != NULL)
+          break;
+    }
+    if (k == XDICT_MAXLENGTH)
+      return xdict_open_mapped(d, fname);
+
+    xdict_init(&tmp);
+    rc = xdict_open_mapped(&tmp, fname);
+    if (rc != 0)  return rc;
+    /* Append everything, then sort once, rather than insert in order. */
+    d->sorted = 0;
+    d->scored |= tmp.scored;
+    for (k=0; k < XDICT_MAXLENGTH; ++k) {
+        for (i=0; i < tmp.len[k]; ++i) {
+            rc = xdict_add(d, xdict_word(&tmp, k, i), k, xdict_score(&tmp, k, i));
+            if (rc < -1) goto done;
         }
-        else if (w[i] == '\0') return 0;
-        else if (p[i] == '1') { if (!is_consonant(w[i])) return 0; }
-        else if (p[i] == '0') { if (!is_vowel(w[i])) return 0; }
-        else if (p[i] != '?') { if (p[i] != w[i]) return 0; }
     }
-    return (w[i] == '\0');
+    rc = 0;
+  done:
+    xdict_free(&tmp);
+    xdict_sort(d);
+    return rc;
 }
 
 
-int xdict_match_simple(const char *w, const char *p)
+static int xdict_write_compressed(void *info, FILE *out)
 {
-    int i;
-    for (i=0; p[i]; ++i) {
-        if (w[i] == '\0') return 0;
-        else if (p[i] == '1') { if (!is_consonant(w[i]))  return 0; }
-        else if (p[i] == '0') { if (!is_vowel(w[i]))  return 0; }
-        else if (p[i] != '?') { if (p[i] != w[i])  return 0; }
+    struct xdict *d = info;
+    unsigned char header[XDICT_FC_HEADERLEN];
+    unsigned long offset = XDICT_FC_HEADERLEN;
+    unsigned char *blocks = NULL;
+    int k;
+
+    if (!d->sorted)
+      xdict_sort(d);
+    /* The header is written again at the end, when the offsets are known. */
+    memset(header, 0, sizeof header);
+    fwrite(header, 1, sizeof header, out);
+    memcpy(header, XDICT_FC_MAGIC, XDICT_BIN_MAGICLEN);
+    put32(header + XDICT_BIN_MAGICLEN, XDICT_FC_VERSION);
+    put32(header + XDICT_BIN_MAGICLEN + 4, d->scored? XDICT_BIN_SCORED: 0);
+    put32(header + XDICT_BIN_MAGICLEN + 8, XDICT_FC_RESTART);
+    for (k=0; k < XDICT_MAXLENGTH; ++k) {
+        unsigned char *p = header + XDICT_BIN_MAGICLEN + 12 + 8*k;
+        size_t n = d->len[k];
+        size_t nblocks = (n + XDICT_FC_RESTART-1) / XDICT_FC_RESTART;
+        unsigned long at = 0;
+        size_t i;
+        void *t;
+        put32(p, n);
+        put32(p+4, offset);
+        if (n == 0) continue;
+
+        t = realloc(blocks, nblocks * 4);
+        if (t == NULL) {
+            free(blocks);
+            return -3;
+        }
+        blocks = t;
+        for (i=0; i < n; ++i) {
+            if (i % XDICT_FC_RESTART == 0) {
+                put32(blocks + 4*(i / XDICT_FC_RESTART), at);
+                at += k;
+            }
+            else {
+                const char *w = xdict_word(d, k, i);
+                const char *prev = w - k;
+                int shared = 0;
+                while (shared < k && w[shared] == prev[shared]) ++shared;
+                at += 1 + k - shared;
+            }
+        }
+        fwrite(blocks, 4, nblocks, out);
+        for (i=0; i < n; ++i) {
+            const char *w = xdict_word(d, k, i);
+            if (i % XDICT_FC_RESTART == 0) {
+                fwrite(w, 1, k, out);
+            }
+            else {
+                const char *prev = w - k;
+                int shared = 0;
+                while (shared < k && w[shared] == prev[shared]) ++shared;
+                putc(shared, out);
+                fwrite(w + shared, 1, k - shared, out);
+            }
+        }
+        offset += nblocks * 4 + at;
+        if (d->scored) {
+            for (i=0; i < n; ++i)
+              putc(xdict_score(d, k, i), out);
+            offset += n;
+        }
     }
-    return (w[i] == '\0');
+    free(blocks);
+    rewind(out);
+    fwrite(header, 1, sizeof header, out);
+    return 0;
 }
 
-
-static int is_purely_alphabetic(const char *pattern)
+/*
+   Write |d| to |fname| in the front-coded format described at the top
+   of this file, sorting it first if need be. Returns 0 on success, -1
+   if the file can't be written, or -3 if we run out of memory.
+*/
+int xdict_save_compressed(struct xdict *d, const char *fname)
 {
-    size_t i;
-    for (i=0; isalpha(pattern[i]); ++i)
-      continue;
-    return (pattern[i] == '\0');
+    return xdict_write_file(fname, xdict_write_compressed, d);
 }
 
-int xdict_find(struct xdict *d, const char *pattern,
-               int (*f)(const char *, void *), void *info)
+
+/*
+   Decode the compressed dictionary in the |n| bytes of |buf|, adding
+   its words to |d|. If |d| was empty, the words arrive in order and
+   need no sorting.
+*/
+static int xdict_load_compressed(struct xdict *d, const unsigned char *buf,
+                                 size_t n)
 {
-    int count = 0;
+    const unsigned char *end = buf + n;
+    unsigned long flags, restart;
+    int was_empty = d->sorted;
+    int rc = 0;
+    int k;
 
-    if (strchr(pattern, '*') == NULL) {
-        size_t len = strlen(pattern);
-        struct word_entry *w;
+    if (n < XDICT_FC_HEADERLEN ||
+        get32(buf + XDICT_BIN_MAGICLEN) != XDICT_FC_VERSION)
+      return -2;
+    flags = get32(buf + XDICT_BIN_MAGICLEN + 4);
+    restart = get32(buf + XDICT_BIN_MAGICLEN + 8);
+    if (restart == 0) return -2;
+    for (k=0; k < XDICT_MAXLENGTH; ++k)
+      was_empty = was_empty && d->len[k] == 0;
+    if (!was_empty)
+      d->sorted = 0;
 
-        if (len < 2 || len >= XDICT_MAXLENGTH) return -1;
-        w = d->words[len];
+    for (k=0; k < XDICT_MAXLENGTH; ++k) {
+        const unsigned char *p = buf + XDICT_BIN_MAGICLEN + 12 + 8*k;
+        size_t count = get32(p);
+        size_t offset = get32(p+4);
+        size_t nblocks = (count + restart-1) / restart;
+        const unsigned char *blocks, *start, *data;
+        char *w;
+        size_t i;
 
-        if (d->sorted && is_purely_alphabetic(pattern)) {
-            /*
-               If the dictionary is sorted and the pattern is
-               simply a word, we can perform a speedy binary search
-               instead of our usual slow linear search.
-            */
-            size_t low = 0;
-            size_t high = d->len[len];
-            while (low < high) {
-                size_t i = low + (high-low)/2;
-                int rc = strcmp(w[i].word, pattern);
-                if (rc == 0) {
-                    if (f != NULL)
-                      f(w[i].word, info);
-                    return 1;
-                }
-                else if (rc > 0) {
-                    high = i;
-                }
-                else {
-                    low = i+1;
-                }
+        if (count == 0) continue;
+        if (k < 3 || offset > n || nblocks > (n - offset) / 4)
+          { rc = -2; goto done; }
+        blocks = buf + offset;
+        start = data = blocks + 4*nblocks;
+        if (xdict_own_bucket(d, k) != 0)  { rc = -3; goto done; }
+        xdict_touch(d, k);
+        if (xdict_grow_bucket(d, k, d->len[k] + count) != 0)  { rc = -3; goto done; }
+        w = xdict_word(d, k, d->len[k]);
+        for (i=0; i < count; ++i, w += k) {
+            size_t shared = 0;
+            if (i % restart == 0) {
+                if (get32(blocks + 4*(i / restart)) != (size_t)(data - start))
+                  { rc = -2; goto done; }
             }
-            return 0;
+            else {
+                if (data == end || (shared = *data++) > (size_t)k)
+                  { rc = -2; goto done; }
+                memcpy(w, w - k, shared);
+            }
+            if ((size_t)(end - data) < k - shared)  { rc = -2; goto done; }
+            memcpy(w + shared, data, k - shared);
+            data += k - shared;
+            /* Don't take the file's word for it that it is sorted. */
+            if (i > 0 && memcmp(w - k, w, k) >= 0)
+              d->sorted = 0;
+        }
+        if (flags & XDICT_BIN_SCORED) {
+            if ((size_t)(end - data) < count)  { rc = -2; goto done; }
+            memcpy(d->scores[k] + d->len[k], data, count);
+            d->scored = 1;
         }
         else {
-            size_t i;
-            for (i=0; i < d->len[len]; ++i) {
-                if (xdict_match_simple(w[i].word, pattern)) {
-                    ++count;
-                    if (f && f(w[i].word, info)) return count;
-                }
-            }
-            return count;
+            memset(d->scores[k] + d->len[k], XDICT_DEFAULT_SCORE, count);
         }
+        d->len[k] += count;
     }
-    else {
-        size_t k, len=0;
-        for (k=0; pattern[k]; ++k)
-          if (pattern[k] != '*') ++len;
+  done:
+    if (!d->sorted)
+      xdict_sort(d);
+    return rc;
+}
 
-        for (k=len; k < XDICT_MAXLENGTH; ++k) {
-            struct word_entry *w = d->words[k];
-            size_t i;
-            for (i=0; i < d->len[k]; ++i) {
-                if (xdict_match(w[i].word, pattern)) {
-                    ++count;
-                    if (f && f(w[i].word, info)) return count;
-                }
-            }
-        }
-        return count;
+void xdict_init(struct xdict *d)
+{
+    int k;
+    d->map = NULL;
+    d->maplen = 0;
+    d->sorted = 1;
+    d->scored = 0;
+    d->indexes = 0;
+    for (k=0; k < XDICT_MAXLENGTH; ++k) {
+        d->words[k] = NULL;
+        d->scores[k] = NULL;
+        d->len[k] = d->cap[k] = 0;
+        d->posindex[k] = NULL;
+        d->columns[k] = NULL;
+        d->hash[k] = NULL;
+        d->byscore[k] = NULL;
+        d->bysuffix[k] = NULL;
+        d->lettermasks[k] = NULL;
+        d->lettersets[k] = NULL;
+        d->ladder[k] = NULL;
     }
+    d->trie = NULL;
+    d->anagrams = NULL;
+    d->threads = 1;
+    d->cache = NULL;
+    d->cache_hits = d->cache_misses = 0;
 }
 
-static int xdict_match_scrabble(const char *w, const int *mincounts, const int *maxcounts)
+
+/*
+   Searches and sorts may use up to |n| threads; zero means one per
+   processor.
+*/
+void xdict_set_threads(struct xdict *d, int n)
 {
-    int counts[256] = {0};
-    for (int i=0; w[i] != '\0'; ++i) {
-        int ch = (unsigned char)w[i];
+#if !defined(XDICT_NO_THREADS) && defined(_SC_NPROCESSORS_ONLN)
+    if (n == 0)
+      n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    d->threads = (n < 1)? 1: n;
+}
+
+
+/*
+   Swap the |i|th and |j|th words of length |k|, and their scores.
+*/
+static void xdict_swap(struct xdict *d, int k, size_t i, size_t j)
+{
+    char t[XDICT_MAXLENGTH];
+    unsigned char s = d->scores[k][i];
+    memcpy(t, xdict_word(d, k, i), k);
+    memcpy(xdict_word(d, k, i), xdict_word(d, k, j), k);
+    memcpy(xdict_word(d, k, j), t, k);
+    d->scores[k][i] = d->scores[k][j];
+    d->scores[k][j] = s;
+}
+
+/*
+   A heapsort needs no scratch space at all, which is what we want
+   when we couldn't get any for the radix sort.
+*/
+static void xdict_heapsort(struct xdict *d, int k)
+{
+    size_t n = d->len[k];
+    size_t i, end;
+    for (i = n/2; i-- > 0; ) {
+        size_t r = i;
+        while (2*r+1 < n) {
+            size_t c = 2*r+1;
+            if (c+1 < n && memcmp(xdict_word(d, k, c), xdict_word(d, k, c+1), k) < 0)
+              ++c;
+            if (memcmp(xdict_word(d, k, r), xdict_word(d, k, c), k) >= 0) break;
+            xdict_swap(d, k, r, c);
+            r = c;
+        }
+    }
+    for (end = n; end > 1; ) {
+        size_t r = 0;
+        xdict_swap(d, k, 0, --end);
+        while (2*r+1 < end) {
+            size_t c = 2*r+1;
+            if (c+1 < end && memcmp(xdict_word(d, k, c), xdict_word(d, k, c+1), k) < 0)
+              ++c;
+            if (memcmp(xdict_word(d, k, r), xdict_word(d, k, c), k) >= 0) break;
+            xdict_swap(d, k, r, c);
+            r = c;
+        }
+    }
+}
+
+/*
+   All the words in a bucket have the same length, so a least-significant-
+   digit radix sort puts them in order in |k| stable counting passes,
+   one per character position, from the last to the first, carrying
+   each word's score along with it. Positions where every word has the
+   same character are skipped. If we can't get the scratch space, fall
+   back to a heapsort. Either way, duplicates then sit next to each
+   other and one pass squeezes them out, keeping the highest score.
+*/
+static void xdict_sort_bucket(struct xdict *d, int k)
+{
+    size_t n = d->len[k];
+    char *w = d->words[k];
+    unsigned char *sc = d->scores[k];
+    char *tmp = malloc(n * (k+1));
+    size_t (*counts)[256] = calloc(k, sizeof *counts);
+    size_t i, kept;
+
+    if (tmp == NULL || counts == NULL) {
+        xdict_heapsort(d, k);
+    }
+    else {
+        char *src = w, *dst = tmp;
+        unsigned char *ssrc = sc, *sdst = (unsigned char *)tmp + n*k;
+        int p;
+        for (i=0; i < n; ++i) {
+            for (p=0; p < k; ++p)
+              counts[p][(unsigned char)w[i*k+p]] += 1;
+        }
+        for (p=k-1; p >= 0; --p) {
+            size_t *c = counts[p];
+            size_t sum = 0;
+            int ch;
+            if (c[(unsigned char)src[p]] == n) continue;
+            for (ch=0; ch < 256; ++ch) {
+                size_t t = c[ch];
+                c[ch] = sum;
+                sum += t;
+            }
+            for (i=0; i < n; ++i) {
+                const char *from = src + i*k;
+                size_t to = c[(unsigned char)from[p]]++;
+                memcpy(dst + k*to, from, k);
+                sdst[to] = ssrc[i];
+            }
+            { char *t = src; src = dst; dst = t; }
+            { unsigned char *t = ssrc; ssrc = sdst; sdst = t; }
+        }
+        if (src != w) {
+            memcpy(w, src, n * k);
+            memcpy(sc, ssrc, n);
+        }
+    }
+    free(counts);
+    free(tmp);
+
+    /* Remove duplicates. */
+    for (i=1, kept=1; i < n; ++i) {
+        if (memcmp(w + i*k, w + (kept-1)*k, k) != 0) {
+            if (kept != i) {
+                memcpy(w + kept*k, w + i*k, k);
+                sc[kept] = sc[i];
+            }
+            ++kept;
+        }
+        else if (sc[i] > sc[kept-1]) {
+            sc[kept-1] = sc[i];
+        }
+    }
+    d->len[k] = kept;
+}
+
+/*
+   With more than one thread, the buckets are sorted in parallel, the
+   biggest first; each thread claims the next unsorted bucket.
+*/
+struct xdict_sortjob {
+    struct xdict *d;
+    int order[XDICT_MAXLENGTH];
+    int n, next;
+#ifndef XDICT_NO_THREADS
+    pthread_mutex_t lock;
+#endif
+};
+
+static void *xdict_sort_worker(void *p)
+{
+    struct xdict_sortjob *job = p;
+    for (;;) {
+        int k;
+#ifndef XDICT_NO_THREADS
+        pthread_mutex_lock(&job->lock);
+#endif
+        k = (job->next < job->n)? job->order[job->next++]: -1;
+#ifndef XDICT_NO_THREADS
+        pthread_mutex_unlock(&job->lock);
+#endif
+        if (k < 0) return NULL;
+        xdict_sort_bucket(job->d, k);
+    }
+}
+
+void xdict_sort(struct xdict *d)
+{
+    struct xdict_sortjob job;
+#ifndef XDICT_NO_THREADS
+    pthread_t tids[XDICT_MAXLENGTH];
+    int nthreads = 0;
+#endif
+    int i, k;
+    job.d = d;
+    job.n = job.next = 0;
+    for (k=0; k < XDICT_MAXLENGTH; ++k) {
+        if (d->len[k] < 2) continue;
+        /* Buckets still in a mapped file are sorted already. */
+        if (d->cap[k] == 0) continue;
+        xdict_touch(d, k);
+        for (i = job.n++; i > 0 && d->len[job.order[i-1]] < d->len[k]; --i)
+          job.order[i] = job.order[i-1];
+        job.order[i] = k;
+    }
+#ifndef XDICT_NO_THREADS
+    pthread_mutex_init(&job.lock, NULL);
+    while (nthreads < d->threads-1 && nthreads < job.n-1) {
+        if (pthread_create(&tids[nthreads], NULL, xdict_sort_worker, &job) != 0)
+          break;
+        ++nthreads;
+    }
+#endif
+    xdict_sort_worker(&job);
+#ifndef XDICT_NO_THREADS
+    while (nthreads > 0)
+      pthread_join(tids[--nthreads], NULL);
+    pthread_mutex_destroy(&job.lock);
+#endif
+    d->sorted = 1;
+}
+
+
+void xdict_free(struct xdict *d)
+{
+    size_t k;
+    for (k=0; k < XDICT_MAXLENGTH; ++k) {
+        xdict_touch(d, k);
+        if (d->cap[k] != 0) {
+            free(d->words[k]);
+            free(d->scores[k]);
+        }
+    }
+    xdict_set_cache(d, 0);
+    xdict_unmap(d);
+}
+
+
+/*
+   Buckets served straight from a mapped file (see |xdict_open_mapped|)
+   are read-only; copy bucket |k| into the heap before modifying it.
+   A mapped bucket is one with words but no capacity. Every bucket in
+   the heap has a score array of the same capacity.
+*/
+static int xdict_own_bucket(struct xdict *d, int k)
+{
+    if (d->cap[k] == 0 && d->words[k] != NULL) {
+        size_t n = d->len[k];
+        char *t = malloc(n * k);
+        unsigned char *s = malloc(n);
+        if (t == NULL || s == NULL) {
+            free(t);
+            free(s);
+            return -3;
+        }
+        memcpy(t, d->words[k], n * k);
+        if (d->scores[k] != NULL)
+          memcpy(s, d->scores[k], n);
+        else
+          memset(s, XDICT_DEFAULT_SCORE, n);
+        d->words[k] = t;
+        d->scores[k] = s;
+        d->cap[k] = n;
+    }
+    return 0;
+}
+
+/* Make room in the owned bucket |k| for at least |want| words. */
+static int xdict_grow_bucket(struct xdict *d, int k, size_t want)
+{
+    void *t;
+    if (want <= d->cap[k]) return 0;
+    t = realloc(d->words[k], want * k);
+    if (t == NULL) return -3;
+    d->words[k] = t;
+    t = realloc(d->scores[k], want);
+    if (t == NULL) return -3;
+    d->scores[k] = t;
+    d->cap[k] = want;
+    return 0;
+}
+
+
+/*
+   Find where |word| belongs among the sorted words of length |k|: set
+   |*at| to the index of the first word not less than it, and return 1
+   if that word is |word| itself.
+*/
+static int xdict_search(const struct xdict *d, const char *word, int k,
+                        size_t *at)
+{
+    size_t low = 0;
+    size_t high = d->len[k];
+    while (low < high) {
+        size_t i = low + (high-low)/2;
+        if (memcmp(xdict_word(d, k, i), word, k) < 0)
+          low = i+1;
+        else
+          high = i;
+    }
+    *at = low;
+    return low < d->len[k] && memcmp(xdict_word(d, k, low), word, k) == 0;
+}
+
+/*
+   A sorted dictionary stays sorted: the new word is inserted in its
+   place, and adding a word that is already there only changes its
+   score, if |score| isn't negative. Only an unsorted dictionary (one
+   being bulk-loaded) simply appends.
+*/
+static int xdict_add(struct xdict *d, const char *word, int k, int score)
+{
+    size_t at;
+    if (k == 0) k = strlen(word);
+    if (k >= XDICT_MAXLENGTH) return -1;
+    if (k <= 2) return -1;
+    if (!d->sorted)
+      at = d->len[k];
+    else if (xdict_search(d, word, k, &at)) {
+        if (score < 0 || score == xdict_score(d, k, at)) return 0;
+        if (xdict_own_bucket(d, k) != 0) return -3;
+        xdict_free_byscore(d->byscore[k]);
+        d->byscore[k] = NULL;
+        xdict_cache_drop(d, k);
+        d->scores[k][at] = score;
+        return 0;
+    }
+    if (xdict_own_bucket(d, k) != 0) return -3;
+    xdict_touch(d, k);
+    if (d->len[k] >= d->cap[k]) {
+        if (xdict_grow_bucket(d, k, d->cap[k] * 2 + 15) != 0) return -3;
+    }
+    memmove(xdict_word(d, k, at+1), xdict_word(d, k, at), (d->len[k] - at) * k);
+    memmove(d->scores[k] + at+1, d->scores[k] + at, d->len[k] - at);
+    memcpy(xdict_word(d, k, at), word, k);
+    d->scores[k][at] = (score < 0)? XDICT_DEFAULT_SCORE: score;
+    d->len[k]++;
+    return 0;
+}
+
+int xdict_addword(struct xdict *d, const char *word, int k)
+{
+    return xdict_add(d, word, k, -1);
+}
+
+int xdict_addword_scored(struct xdict *d, const char *word, int k, int score)
+{
+    if (score < 0) score = 0;
+    if (score > XDICT_MAXSCORE) score = XDICT_MAXSCORE;
+    d->scored = 1;
+    return xdict_add(d, word, k, score);
+}
+
+
+/*
+   Remove the |i|th word of length |k|, closing up the gap so that the
+   words after it keep their order. Return -1 if there is no such word.
+*/
+int xdict_remove_at(struct xdict *d, int k, size_t i)
+{
+    if (k < 0 || k >= XDICT_MAXLENGTH || i >= d->len[k]) return -1;
+    if (xdict_own_bucket(d, k) != 0) return -3;
+    xdict_touch(d, k);
+    d->len[k]--;
+    memmove(xdict_word(d, k, i), xdict_word(d, k, i+1), (d->len[k] - i) * k);
+    memmove(d->scores[k] + i, d->scores[k] + i+1, d->len[k] - i);
+    return 0;
+}
+
+
+/*
+   Remove every word of length |k| for which |f| returns nonzero,
+   keeping the rest in order, in a single pass. Return the number of
+   words removed, or -1 if no word can have length |k|.
+*/
+int xdict_remove_if(struct xdict *d, int k,
+                    int (*f)(const char *, void *), void *info)
+{
+    char buf[XDICT_MAXLENGTH];
+    size_t i, n;
+    size_t kept = 0;
+    int owned = 0;
+
+    if (k < 0 || k >= XDICT_MAXLENGTH) return -1;
+    n = d->len[k];
+
+    for (i=0; i < n; ++i) {
+        memcpy(buf, xdict_word(d, k, i), k);
+        buf[k] = '\0';
+        if (f(buf, info)) {
+            if (!owned) {
+                if (xdict_own_bucket(d, k) != 0) return -3;
+                xdict_touch(d, k);
+                owned = 1;
+            }
+            continue;
+        }
+        if (kept != i) {
+            memcpy(xdict_word(d, k, kept), buf, k);
+            d->scores[k][kept] = d->scores[k][i];
+        }
+        ++kept;
+    }
+    d->len[k] = kept;
+    return n - kept;
+}
+
+
+/*
+   Remove every word scoring less than |minscore|, keeping the rest in
+   order. Return the number of words removed.
+*/
+int xdict_remove_below(struct xdict *d, int minscore)
+{
+    int count = 0;
+    int k;
+    for (k=0; k < XDICT_MAXLENGTH; ++k) {
+        size_t i, n = d->len[k];
+        size_t kept = 0;
+        for (i=0; i < n && xdict_score(d, k, i) >= minscore; ++i) ;
+        if (i == n) continue;
+        if (xdict_own_bucket(d, k) != 0) return -3;
+        xdict_touch(d, k);
+        for (kept = i; i < n; ++i) {
+            if (d->scores[k][i] < minscore) continue;
+            memcpy(xdict_word(d, k, kept), xdict_word(d, k, i), k);
+            d->scores[k][kept] = d->scores[k][i];
+            ++kept;
+        }
+        count += n - kept;
+        d->len[k] = kept;
+    }
+    return count;
+}
+
+
+int xdict_remword(struct xdict *d, const char *word, int k)
+{
+    int count = 0;
+    size_t i;
+
+    if (k == 0) k = strlen(word);
+    if (k >= XDICT_MAXLENGTH) return -1;
+    if (k <= 2) return -1;
+    if (d->sorted) {
+        if (!xdict_search(d, word, k, &i)) return 0;
+        return (xdict_remove_at(d, k, i) != 0)? -3: 1;
+    }
+    for (i=0; i < d->len[k]; ) {
+        if (memcmp(xdict_word(d, k, i), word, k) == 0) {
+            if (xdict_remove_at(d, k, i) != 0) return -3;
+            ++count;
+        }
+        else ++i;
+    }
+    return count;
+}
+
+
+static int xdict_remmatch_test(const char *w, void *info)
+{
+    return xdict_pattern_match(info, w, strlen(w));
+}
+
+/*
+   A pattern with a '*' wildcard is matched against words of every
+   length, whatever |k| says; otherwise a nonzero |k| gives the length.
+*/
+int xdict_remmatch(struct xdict *d, const char *pat, int k)
+{
+    struct xdict_pattern prog;
+    int count = 0;
+    int kmax, rc;
+
+    if (k != 0 && strpbrk(pat, "*?01[") == NULL)
+      return xdict_remword(d, pat, k);
+    rc = xdict_compile_pattern(&prog, pat);
+    if (rc == -2) return 0;
+    if (rc != 0) return -1;
+    if (k != 0 && prog.nsegs == 1) {
+        if (k >= XDICT_MAXLENGTH) return -1;
+        if (k <= 2) return -1;
+        kmax = k;
+    }
+    else {
+        /*
+           The client has not specified a word length, or the pattern
+           contains a '*' wildcard. Unless the pattern is of fixed
+           length, we must check all possible word lengths.
+        */
+        k = prog.len;
+        kmax = (prog.nsegs == 1)? k: XDICT_MAXLENGTH-1;
+    }
+    for ( ; k <= kmax; ++k) {
+        rc = xdict_remove_if(d, k, xdict_remmatch_test, &prog);
+        if (rc < 0) return rc;
+        count += rc;
+    }
+    return count;
+}
+
+
+/*
+   These routines interpret the pattern afresh for each word. Searches
+   compile the pattern once instead; see |xdict_compile_pattern|.
+*/
+int xdict_match(const char *w, const char *p)
+{
+    int i, j;
+    for (i=0; p[i]; ++i) {
+        if (p[i] == '*') {
+            for (j=i; w[j]; ++j)
+              if (xdict_match(w+j, p+i+1)) return 1;
+            if (xdict_match(w+j, p+i+1)) return 1;
+            return 0;
+        }
+        else if (w[i] == '\0') return 0;
+        else if (p[i] == '1') { if (!is_consonant(w[i])) return 0; }
+        else if (p[i] == '0') { if (!is_vowel(w[i])) return 0; }
+        else if (p[i] != '?') { if (p[i] != w[i]) return 0; }
+    }
+    return (w[i] == '\0');
+}
+
+
+int xdict_match_simple(const char *w, const char *p)
+{
+    int i;
+    for (i=0; p[i]; ++i) {
+        if (w[i] == '\0') return 0;
+        else if (p[i] == '1') { if (!is_consonant(w[i]))  return 0; }
+        else if (p[i] == '0') { if (!is_vowel(w[i]))  return 0; }
+        else if (p[i] != '?') { if (p[i] != w[i])  return 0; }
+    }
+    return (w[i] == '\0');
+}
+
+
+/*
+   Our own callers that want to know where each match is, not just what
+   it says, pass |xdict_locate| as the callback and a |struct
+   xdict_locator| as its |info|. |xdict_report| then gives |found| the
+   word (not null-terminated), its length and its ordinal, which is
+   simply read off the pointer when the search hands us the bucket's
+   own copy of the word; otherwise it must be looked up, and is -1 if
+   it isn't there. Only a sorted dictionary can be searched this way.
+*/
+struct xdict_locator {
+    struct xdict *d;
+    int (*found)(struct xdict_locator *loc, const char *w, int k, size_t i);
+};
+
+static int xdict_locate_at(struct xdict_locator *loc, const char *w, int k)
+{
+    const struct xdict *d = loc->d;
+    const char *base = d->words[k];
+    size_t i;
+    if (d->len[k] > 0 && w >= base && w < base + d->len[k]*k)
+      i = (w - base) / k;
+    else if (!xdict_search(d, w, k, &i))
+      i = (size_t)-1;
+    return loc->found(loc, w, k, i);
+}
+
+static int xdict_locate(const char *w, void *info)
+{
+    return xdict_locate_at(info, w, strlen(w));
+}
+
+/*
+   Pass the |k|-letter word |w| to the client's callback |f|, which
+   expects a null-terminated string.
+*/
+static int xdict_report(const char *w, size_t k,
+                        int (*f)(const char *, void *), void *info)
+{
+    char buf[XDICT_MAXLENGTH];
+    if (f == xdict_locate)
+      return xdict_locate_at(info, w, k);
+    memcpy(buf, w, k);
+    buf[k] = '\0';
+    return f(buf, info);
+}
+
+
+/*
+   Compile |pattern| into |pat|. Besides the letters and the usual
+   wildcards '?', '0', '1' and '*', a pattern may contain bracketed
+   classes such as "[aeiou]" or "[^st]"; a class may list letters and
+   the '0' and '1' wildcards. Returns -1 if the pattern is malformed,
+   or -2 if it has more fixed positions than the longest possible word.
+*/
+int xdict_compile_pattern(struct xdict_pattern *pat, const char *p)
+{
+    pat->len = 0;
+    pat->nsegs = 1;
+    pat->seg[0] = 0;
+    while (*p != '\0') {
+        int ch = (unsigned char)*p++;
+        uint32_t m;
+        unsigned char lit = 0;
+        if (ch == '*') {
+            while (*p == '*') ++p;
+            pat->seg[pat->nsegs++] = pat->len;
+            continue;
+        }
+        else if (ch == '?') m = XDICT_ANY;
+        else if (ch == '0') m = XDICT_VOWELS;
+        else if (ch == '1') m = XDICT_CONSONANTS;
+        else if ('a' <= ch && ch <= 'z') m = 1u << (ch-'a');
+        else if (ch == '[') {
+            int negate = (*p == '^');
+            if (negate) ++p;
+            m = 0;
+            for ( ; *p != ']'; ++p) {
+                ch = (unsigned char)*p;
+                if ('a' <= ch && ch <= 'z') m |= 1u << (ch-'a');
+                else if (ch == '0') m |= XDICT_VOWELS;
+                else if (ch == '1') m |= XDICT_CONSONANTS;
+                else return -1;
+            }
+            ++p;
+            if (negate) m = XDICT_ANY & ~m;
+            if (m == 0) return -1;
+        }
+        else {
+            m = XDICT_OTHER;
+            lit = ch;
+        }
+        if (pat->len == XDICT_MAXLENGTH-1) return -2;
+        pat->masks[pat->len] = m;
+        pat->lits[pat->len] = lit;
+        pat->len += 1;
+    }
+    pat->seg[pat->nsegs] = pat->len;
+    return 0;
+}
+
+static uint32_t xdict_charbit(int ch)
+{
+    return ('a' <= ch && ch <= 'z')? (1u << (ch-'a')): XDICT_OTHER;
+}
+
+/* Does |w| match positions |from| through |to|-1 of |pat|? */
+static int xdict_pattern_match_at(const struct xdict_pattern *pat,
+                                  int from, int to, const char *w)
+{
+    int i;
+    for (i=from; i < to; ++i, ++w) {
+        int ch = (unsigned char)*w;
+        if (!(pat->masks[i] & xdict_charbit(ch))) return 0;
+        if (pat->lits[i] && pat->lits[i] != ch) return 0;
+    }
+    return 1;
+}
+
+/*
+   A compiled pattern never needs to backtrack: the first and last
+   segments are anchored to the ends of the word, and each segment
+   in between may as well take the leftmost place where it matches.
+*/
+int xdict_pattern_match(const struct xdict_pattern *pat,
+                        const char *w, size_t n)
+{
+    int s, last = pat->nsegs-1;
+    size_t pos, end;
+    if (last == 0)
+      return (n == (size_t)pat->len) && xdict_pattern_match_at(pat, 0, pat->len, w);
+    if (n < (size_t)pat->len) return 0;
+    end = n - (pat->len - pat->seg[last]);
+    if (!xdict_pattern_match_at(pat, 0, pat->seg[1], w)) return 0;
+    if (!xdict_pattern_match_at(pat, pat->seg[last], pat->len, w+end)) return 0;
+    pos = pat->seg[1];
+    for (s=1; s < last; ++s) {
+        size_t seglen = pat->seg[s+1] - pat->seg[s];
+        while (pos + seglen <= end &&
+               !xdict_pattern_match_at(pat, pat->seg[s], pat->seg[s+1], w+pos))
+          ++pos;
+        if (pos + seglen > end) return 0;
+        pos += seglen;
+    }
+    return 1;
+}
+
+
+/*
+   The optional positional index. For each length |k|, position |p|
+   and letter, it holds a bitmap with bit |i| set if the |i|th word of
+   length |k| has that letter in position |p|. Two more bitmaps per
+   position are the ORs of the vowels and of the consonants, for the
+   '0' and '1' wildcards. A fixed-length pattern query ANDs together
+   one bitmap per constrained position and visits only the surviving
+   words. The index is discarded whenever its bucket is modified, and
+   rebuilt on the next query that wants it.
+*/
+#define POSINDEX_VOWEL 26
+#define POSINDEX_CONSONANT 27
+#define POSINDEX_CLASSES 28
+
+struct xdict_posindex {
+    size_t nblocks;  /* 64-bit words per bitmap */
+    uint64_t *bits;  /* [position][class][block] */
+};
+
+static uint64_t *posindex_bitmap(struct xdict_posindex *x, size_t p, int cls)
+{
+    return x->bits + (p * POSINDEX_CLASSES + cls) * x->nblocks;
+}
+
+static struct xdict_posindex *xdict_build_posindex(struct xdict *d, int k)
+{
+    struct xdict_posindex *x = malloc(sizeof *x);
+    size_t i, n = d->len[k];
+    const char *w = d->words[k];
+    if (x == NULL) return NULL;
+    x->nblocks = (n + 63) / 64;
+    x->bits = calloc(k * POSINDEX_CLASSES * x->nblocks, sizeof *x->bits);
+    if (x->bits == NULL) {
+        free(x);
+        return NULL;
+    }
+    for (i=0; i < n; ++i, w += k) {
+        uint64_t bit = (uint64_t)1 << (i % 64);
+        size_t block = i / 64;
+        int p;
+        for (p=0; p < k; ++p) {
+            int ch = (unsigned char)w[p];
+            if (ch < 'a' || ch > 'z') continue;
+            posindex_bitmap(x, p, ch-'a')[block] |= bit;
+            if (is_vowel(ch))
+              posindex_bitmap(x, p, POSINDEX_VOWEL)[block] |= bit;
+            if (is_consonant(ch))
+              posindex_bitmap(x, p, POSINDEX_CONSONANT)[block] |= bit;
+        }
+    }
+    return x;
+}
+
+static void xdict_free_posindex(struct xdict_posindex *x)
+{
+    if (x == NULL) return;
+    free(x->bits);
+    free(x);
+}
+
+/*
+   The optional columnar copy of each bucket stores the words
+   transposed: all the first letters, then all the second letters, and
+   so on, with each column padded to a multiple of 32 words. A vector
+   compare then checks one pattern position against 16 or 32 words at
+   once; see |xdict_find_columns|.
+*/
+struct xdict_columns {
+    size_t npad;           /* words per column, rounded up */
+    unsigned char *bytes;  /* [position][word] */
+};
+
+static struct xdict_columns *xdict_build_columns(struct xdict *d, int k)
+{
+    struct xdict_columns *x = malloc(sizeof *x);
+    size_t i, n = d->len[k];
+    const char *w = d->words[k];
+    if (x == NULL) return NULL;
+    x->npad = (n + 31) / 32 * 32;
+    x->bytes = calloc(k, x->npad);
+    if (x->bytes == NULL) {
+        free(x);
+        return NULL;
+    }
+    for (i=0; i < n; ++i, w += k) {
+        int p;
+        for (p=0; p < k; ++p)
+          x->bytes[p * x->npad + i] = w[p];
+    }
+    return x;
+}
+
+static void xdict_free_columns(struct xdict_columns *x)
+{
+    if (x == NULL) return;
+    free(x->bytes);
+    free(x);
+}
+
+/*
+   The optional trie holds every word of every length, sharing common
+   prefixes. Its nodes are laid out in preorder, so a node's children
+   follow it directly: the first is at |n+1|, and each node's |next|
+   is the index just past its own subtree, which is where its next
+   sibling (if any) begins. Siblings are in character order. A node
+   records the character on the edge leading into it and, if a word
+   ends there, that word's ordinal within its length bucket. Because
+   of those ordinals the trie can't be minimized into a DAWG: two words
+   sharing a suffix still end at different nodes. A trie is only built
+   over a sorted dictionary, which has no duplicate words.
+*/
+struct xdict_trie_node {
+    uint32_t next;
+    int32_t word;
+    unsigned char ch;
+    unsigned char depth;
+};
+
+struct xdict_trie {
+    struct xdict_trie_node *nodes;
+    size_t len;
+};
+
+/*
+   While the trie is being built, each node points to its first child
+   and its next sibling instead; index 0 is the root, so 0 also means
+   "none".
+*/
+struct xdict_trie_builder {
+    struct xdict_trie_bnode {
+        uint32_t child;
+        uint32_t sibling;
+        int32_t word;
+        unsigned char ch;
+    } *nodes;
+    size_t len, cap;
+};
+
+static int xdict_trie_newnode(struct xdict_trie_builder *t, int ch)
+{
+    struct xdict_trie_bnode *n;
+    if (t->len == t->cap) {
+        size_t newcap = t->cap*2 + 1024;
+        n = realloc(t->nodes, newcap * sizeof *n);
+        if (n == NULL) return -3;
+        t->nodes = n;
+        t->cap = newcap;
+    }
+    n = &t->nodes[t->len++];
+    n->child = n->sibling = 0;
+    n->word = -1;
+    n->ch = ch;
+    return 0;
+}
+
+/* Add |w| to the trie; set |*last| to the node where it ends. */
+static int xdict_trie_insert(struct xdict_trie_builder *t,
+                             const char *w, int k, uint32_t *last)
+{
+    uint32_t node = 0;
+    int p;
+    for (p=0; p < k; ++p) {
+        int ch = (unsigned char)w[p];
+        uint32_t prev = 0, cur = t->nodes[node].child;
+        while (cur != 0 && t->nodes[cur].ch < ch) {
+            prev = cur;
+            cur = t->nodes[cur].sibling;
+        }
+        if (cur == 0 || t->nodes[cur].ch != ch) {
+            uint32_t n = t->len;
+            if (xdict_trie_newnode(t, ch) != 0) return -3;
+            t->nodes[n].sibling = cur;
+            if (prev == 0) t->nodes[node].child = n;
+            else t->nodes[prev].sibling = n;
+            cur = n;
+        }
+        node = cur;
+    }
+    *last = node;
+    return 0;
+}
+
+static uint32_t xdict_trie_flatten(const struct xdict_trie_builder *t,
+                                   uint32_t node, int depth,
+                                   struct xdict_trie_node *out, uint32_t at)
+{
+    uint32_t c, pos = at+1;
+    out[at].ch = t->nodes[node].ch;
+    out[at].word = t->nodes[node].word;
+    out[at].depth = depth;
+    for (c = t->nodes[node].child; c != 0; c = t->nodes[c].sibling)
+      pos = xdict_trie_flatten(t, c, depth+1, out, pos);
+    out[at].next = pos;
+    return pos;
+}
+
+static void xdict_free_trie(struct xdict_trie *t)
+{
+    if (t == NULL) return;
+    free(t->nodes);
+    free(t);
+}
+
+static struct xdict_trie *xdict_build_trie(struct xdict *d)
+{
+    struct xdict_trie_builder b = { NULL, 0, 0 };
+    struct xdict_trie *t = NULL;
+    uint32_t node;
+    int k;
+    size_t i;
+    if (xdict_trie_newnode(&b, 0) != 0) goto done;
+    for (k=0; k < XDICT_MAXLENGTH; ++k) {
+        const char *w = d->words[k];
+        for (i=0; i < d->len[k]; ++i, w += k) {
+            if (xdict_trie_insert(&b, w, k, &node) != 0) goto done;
+            b.nodes[node].word = i;
+        }
+    }
+    t = malloc(sizeof *t);
+    if (t == NULL) goto done;
+    t->len = b.len;
+    t->nodes = malloc(b.len * sizeof *t->nodes);
+    if (t->nodes == NULL) {
+        free(t);
+        t = NULL;
+        goto done;
+    }
+    xdict_trie_flatten(&b, 0, 0, t->nodes, 0);
+  done:
+    free(b.nodes);
+    return t;
+}
+
+/*
+   The optional anagram index is a trie like the one above, but over
+   each word's letters in sorted order (its "signature"), so that all
+   the anagrams of a word end at the same node. That node's |word|
+   numbers its group; the ordinals of the group's words, all of the
+   same length, are |ordinals[start[g]]| up to |ordinals[start[g+1]]|.
+*/
+struct xdict_anagrams {
+    struct xdict_trie trie;
+    uint32_t *start;
+    uint32_t *ordinals;
+};
+
+static void xdict_signature(const char *w, int k, char *sig)
+{
+    int i, j;
+    for (i=0; i < k; ++i) {
+        unsigned char ch = w[i];
+        for (j=i; j > 0 && (unsigned char)sig[j-1] > ch; --j)
+          sig[j] = sig[j-1];
+        sig[j] = ch;
+    }
+}
+
+static void xdict_free_anagrams(struct xdict_anagrams *x)
+{
+    if (x == NULL) return;
+    free(x->trie.nodes);
+    free(x->start);
+    free(x->ordinals);
+    free(x);
+}
+
+static struct xdict_anagrams *xdict_build_anagrams(struct xdict *d)
+{
+    struct xdict_trie_builder b = { NULL, 0, 0 };
+    struct xdict_anagrams *x = NULL;
+    uint32_t *groups = NULL;
+    uint32_t ngroups = 0;
+    size_t total = 0, at;
+    char sig[XDICT_MAXLENGTH];
+    int k;
+    size_t i;
+
+    for (k=0; k < XDICT_MAXLENGTH; ++k)
+      total += d->len[k];
+    groups = malloc((total+1) * sizeof *groups);
+    if (groups == NULL) goto oom;
+    if (xdict_trie_newnode(&b, 0) != 0) goto oom;
+    at = 0;
+    for (k=0; k < XDICT_MAXLENGTH; ++k) {
+        const char *w = d->words[k];
+        for (i=0; i < d->len[k]; ++i, w += k) {
+            uint32_t node;
+            xdict_signature(w, k, sig);
+            if (xdict_trie_insert(&b, sig, k, &node) != 0) goto oom;
+            if (b.nodes[node].word < 0)
+              b.nodes[node].word = ngroups++;
+            groups[at++] = b.nodes[node].word;
+        }
+    }
+
+    x = malloc(sizeof *x);
+    if (x == NULL) goto oom;
+    x->trie.len = b.len;
+    x->trie.nodes = malloc(b.len * sizeof *x->trie.nodes);
+    x->start = calloc(ngroups + 1, sizeof *x->start);
+    x->ordinals = malloc((total+1) * sizeof *x->ordinals);
+    if (x->trie.nodes == NULL || x->start == NULL || x->ordinals == NULL)
+      goto oom;
+    xdict_trie_flatten(&b, 0, 0, x->trie.nodes, 0);
+
+    /* Counting sort the ordinals by group. */
+    for (at=0; at < total; ++at)
+      x->start[groups[at] + 1] += 1;
+    for (i=0; i < ngroups; ++i)
+      x->start[i+1] += x->start[i];
+    at = 0;
+    for (k=0; k < XDICT_MAXLENGTH; ++k) {
+        for (i=0; i < d->len[k]; ++i, ++at)
+          x->ordinals[x->start[groups[at]]++] = i;
+    }
+    for (i=ngroups; i > 0; --i)
+      x->start[i] = x->start[i-1];
+    x->start[0] = 0;
+
+    free(groups);
+    free(b.nodes);
+    return x;
+  oom:
+    xdict_free_anagrams(x);
+    free(groups);
+    free(b.nodes);
+    return NULL;
+}
+
+/*
+   The optional hash index gives each bucket an open-addressing table
+   of ordinals (plus one, so that 0 marks an empty slot), at most half
+   full, probed linearly. The words themselves stay in the arena.
+*/
+struct xdict_hash {
+    size_t mask;
+    uint32_t *slots;
+};
+
+static uint32_t xdict_hashword(const char *w, size_t k)
+{
+    uint32_t h = 2166136261u;  /* FNV-1a */
+    size_t i;
+    for (i=0; i < k; ++i)
+      h = (h ^ (unsigned char)w[i]) * 16777619u;
+    return h;
+}
+
+static struct xdict_hash *xdict_build_hash(struct xdict *d, int k)
+{
+    struct xdict_hash *x = malloc(sizeof *x);
+    size_t i, n = d->len[k];
+    size_t size = 16;
+    if (x == NULL) return NULL;
+    while (size < 2*n) size *= 2;
+    x->mask = size-1;
+    x->slots = calloc(size, sizeof *x->slots);
+    if (x->slots == NULL) {
+        free(x);
+        return NULL;
+    }
+    for (i=0; i < n; ++i) {
+        size_t h = xdict_hashword(xdict_word(d, k, i), k) & x->mask;
+        while (x->slots[h] != 0)
+          h = (h+1) & x->mask;
+        x->slots[h] = i+1;
+    }
+    return x;
+}
+
+static void xdict_free_hash(struct xdict_hash *x)
+{
+    if (x == NULL) return;
+    free(x->slots);
+    free(x);
+}
+
+
+/*
+   The score index lists the ordinals of a bucket's words from the
+   highest score to the lowest (and in order within each score), so
+   that the words scoring at least |s| are exactly the first
+   |atleast[s]| of them. It is built by a single counting sort.
+*/
+struct xdict_byscore {
+    size_t atleast[XDICT_MAXSCORE+2];
+    uint32_t *ordinals;
+};
+
+static struct xdict_byscore *xdict_build_byscore(struct xdict *d, int k)
+{
+    struct xdict_byscore *x = malloc(sizeof *x);
+    size_t next[XDICT_MAXSCORE+1];
+    size_t i, n = d->len[k];
+    int s;
+    if (x == NULL) return NULL;
+    x->ordinals = malloc((n+1) * sizeof *x->ordinals);
+    if (x->ordinals == NULL) {
+        free(x);
+        return NULL;
+    }
+    memset(x->atleast, 0, sizeof x->atleast);
+    for (i=0; i < n; ++i)
+      x->atleast[xdict_score(d, k, i)] += 1;
+    for (s = XDICT_MAXSCORE; s >= 0; --s) {
+        next[s] = x->atleast[s+1];
+        x->atleast[s] += x->atleast[s+1];
+    }
+    for (i=0; i < n; ++i)
+      x->ordinals[next[xdict_score(d, k, i)]++] = i;
+    return x;
+}
+
+static void xdict_free_byscore(struct xdict_byscore *x)
+{
+    if (x == NULL) return;
+    free(x->ordinals);
+    free(x);
+}
+
+/*
+   The suffix index lists the ordinals of a bucket's words in the order
+   of their reversals, so that the words ending in a given suffix are
+   one contiguous run of it, just as the words beginning with a given
+   prefix are one contiguous run of the sorted bucket. It is built by
+   an LSD radix sort that takes the first letter as least significant.
+*/
+static uint32_t *xdict_build_bysuffix(const struct xdict *d, int k)
+{
+    size_t i, n = d->len[k];
+    uint32_t *ord = malloc((n+1) * sizeof *ord);
+    uint32_t *tmp = malloc((n+1) * sizeof *tmp);
+    int pos, c;
+    if (ord == NULL || tmp == NULL) {
+        free(ord);
+        free(tmp);
+        return NULL;
+    }
+    for (i=0; i < n; ++i)
+      ord[i] = i;
+    for (pos=0; pos < k; ++pos) {
+        size_t next[257] = {0};
+        uint32_t *t;
+        for (i=0; i < n; ++i)
+          next[(unsigned char)xdict_word(d, k, i)[pos] + 1] += 1;
+        for (c=0; c < 256; ++c)
+          next[c+1] += next[c];
+        for (i=0; i < n; ++i)
+          tmp[next[(unsigned char)xdict_word(d, k, ord[i])[pos]]++] = ord[i];
+        t = ord; ord = tmp; tmp = t;
+    }
+    free(tmp);
+    return ord;
+}
+
+/*
+   Letter-set queries ask only which letters a word uses, not how many
+   times or where. Each word's letters are summarized as the OR of
+   their |xdict_charbit|s, computed for a whole bucket the first time
+   a query needs them, so that testing a word is an AND and a compare.
+*/
+static uint32_t *xdict_build_lettermasks(const struct xdict *d, int k)
+{
+    size_t i, n = d->len[k];
+    uint32_t *x = malloc((n+1) * sizeof *x);
+    int p;
+    if (x == NULL) return NULL;
+    for (i=0; i < n; ++i) {
+        const char *w = xdict_word(d, k, i);
+        uint32_t m = 0;
+        for (p=0; p < k; ++p)
+          m |= xdict_charbit((unsigned char)w[p]);
+        x[i] = m;
+    }
+    return x;
+}
+
+/*
+   The optional letter-set index groups a bucket's words by their
+   masks, ordered by the number of different letters and then by
+   mask. Group |g| has mask |masks[g]| and its words' ordinals are
+   |ordinals[start[g]]| up to |ordinals[start[g+1]]|; the groups of
+   words with |p| different letters begin at |bypop[p]|. A query can
+   then skip every group with too few or too many letters at once.
+*/
+#define XDICT_MASKBITS 27  /* 26 letters and |XDICT_OTHER| */
+
+struct xdict_lettersets {
+    size_t bypop[XDICT_MASKBITS+2];
+    uint32_t *masks;
+    uint32_t *start;
+    uint32_t *ordinals;
+};
+
+static int xdict_cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static struct xdict_lettersets *xdict_build_lettersets(const struct xdict *d,
+                                                       int k,
+                                                       const uint32_t *lm)
+{
+    size_t i, g, n = d->len[k];
+    struct xdict_lettersets *x = malloc(sizeof *x);
+    uint64_t *keys = malloc((n+1) * sizeof *keys);
+    int p;
+    if (x != NULL) {
+        x->masks = malloc((n+1) * sizeof *x->masks);
+        x->start = malloc((n+1) * sizeof *x->start);
+        x->ordinals = malloc((n+1) * sizeof *x->ordinals);
+    }
+    if (x == NULL || keys == NULL || x->masks == NULL ||
+            x->start == NULL || x->ordinals == NULL) {
+        free(keys);
+        xdict_free_lettersets(x);
+        return NULL;
+    }
+    /* The sort key is (letters << 27 | mask) << 32 | ordinal. */
+    for (i=0; i < n; ++i) {
+        uint64_t key = ((uint64_t)xdict_popcount64(lm[i]) << XDICT_MASKBITS) | lm[i];
+        keys[i] = (key << 32) | i;
+    }
+    qsort(keys, n, sizeof *keys, xdict_cmp_u64);
+    for (p=0; p <= XDICT_MASKBITS+1; ++p)
+      x->bypop[p] = 0;
+    g = 0;
+    for (i=0; i < n; ++i) {
+        uint32_t m = (keys[i] >> 32) & XDICT_ANY;
+        if (i == 0 || m != x->masks[g-1]) {
+            x->masks[g] = m;
+            x->start[g] = i;
+            x->bypop[xdict_popcount64(m) + 1] = g+1;
+            ++g;
+        }
+        x->ordinals[i] = (uint32_t)keys[i];
+    }
+    x->start[g] = n;
+    /* So far |bypop[p+1]| is one past the last group with |p| letters, or 0. */
+    for (p=1; p <= XDICT_MASKBITS+1; ++p) {
+        if (x->bypop[p] < x->bypop[p-1])
+          x->bypop[p] = x->bypop[p-1];
+    }
+    free(keys);
+    return x;
+}
+
+static void xdict_free_lettersets(struct xdict_lettersets *x)
+{
+    if (x == NULL) return;
+    free(x->masks);
+    free(x->start);
+    free(x->ordinals);
+    free(x);
+}
+
+/*
+   The ladder graph of a bucket links each word to the words made from
+   it by changing a single letter: the neighbors of word |i| are the
+   ordinals |adj[start[i]]| up to |adj[start[i+1]]|. To build it we
+   hash every word once per position with that position blanked out,
+   as in "c?t", so that the words sharing a key are neighbors through
+   that position and we never compare two words that aren't. Each
+   (position, key) pair is a group; |group[p*n + i]| is the group of
+   word |i| at position |p|.
+*/
+struct xdict_ladder {
+    uint32_t *start;
+    uint32_t *adj;
+};
+
+static int xdict_same_but(const char *a, const char *b, int k, int p)
+{
+    return memcmp(a, b, p) == 0 && memcmp(a+p+1, b+p+1, k-p-1) == 0;
+}
+
+static void xdict_free_ladder(struct xdict_ladder *x)
+{
+    if (x == NULL) return;
+    free(x->start);
+    free(x->adj);
+    free(x);
+}
+
+static struct xdict_ladder *xdict_build_ladder(const struct xdict *d, int k)
+{
+    size_t n = d->len[k];
+    size_t size = 16;
+    size_t i, g, ngroups = 0;
+    struct xdict_ladder *x = malloc(sizeof *x);
+    uint32_t *slots, *group, *gstart, *members;
+    int p;
+
+    while (size < 2*n) size *= 2;
+    slots = malloc(size * sizeof *slots);
+    group = malloc((k*n + 1) * sizeof *group);
+    gstart = calloc(k*n + 2, sizeof *gstart);
+    members = malloc((k*n + 1) * sizeof *members);
+    if (x != NULL) {
+        x->start = malloc((n+1) * sizeof *x->start);
+        x->adj = NULL;
+    }
+    if (x == NULL || slots == NULL || group == NULL || gstart == NULL ||
+            members == NULL || x->start == NULL) {
+        free(slots);
+        free(group);
+        free(gstart);
+        free(members);
+        xdict_free_ladder(x);
+        return NULL;
+    }
+
+    /* Number the groups, counting each one's words in |gstart[g+1]|. */
+    for (p=0; p < k; ++p) {
+        memset(slots, 0, size * sizeof *slots);
+        for (i=0; i < n; ++i) {
+            const char *w = xdict_word(d, k, i);
+            uint32_t h = 2166136261u;  /* FNV-1a, as in |xdict_hashword| */
+            int j;
+            for (j=0; j < k; ++j)
+              h = (h ^ ((j == p)? '?': (unsigned char)w[j])) * 16777619u;
+            for (h &= size-1; slots[h] != 0; h = (h+1) & (size-1)) {
+                if (xdict_same_but(xdict_word(d, k, slots[h]-1), w, k, p))
+                  break;
+            }
+            if (slots[h] == 0) {
+                slots[h] = i+1;
+                group[p*n + i] = ngroups++;
+            }
+            else
+              group[p*n + i] = group[p*n + slots[h]-1];
+            gstart[group[p*n + i] + 1] += 1;
+        }
+    }
+
+    /* Each word's degree is the size of each of its groups, less one. */
+    x->start[0] = 0;
+    for (i=0; i < n; ++i) {
+        uint32_t deg = 0;
+        for (p=0; p < k; ++p)
+          deg += gstart[group[p*n + i] + 1] - 1;
+        x->start[i+1] = x->start[i] + deg;
+    }
+    x->adj = malloc((x->start[n] + 1) * sizeof *x->adj);
+
+    /* List the members of each group together, then link them pairwise. */
+    if (x->adj != NULL) {
+        for (g=0; g < ngroups; ++g)
+          gstart[g+1] += gstart[g];
+        for (p=0; p < k; ++p)
+          for (i=0; i < n; ++i)
+            members[gstart[group[p*n + i]]++] = i;
+        for (g = ngroups; g > 0; --g)
+          gstart[g] = gstart[g-1];
+        gstart[0] = 0;
+        for (i=0; i < n; ++i)
+          group[i] = x->start[i];  /* now the next free edge of word |i| */
+        for (g=0; g < ngroups; ++g) {
+            uint32_t a, b;
+            for (a = gstart[g]; a < gstart[g+1]; ++a)
+              for (b = gstart[g]; b < gstart[g+1]; ++b)
+                if (a != b) x->adj[group[members[a]]++] = members[b];
+        }
+    }
+    free(slots);
+    free(group);
+    free(gstart);
+    free(members);
+    if (x->adj == NULL) {
+        xdict_free_ladder(x);
+        return NULL;
+    }
+    return x;
+}
+
+int xdict_build_index(struct xdict *d, int which)
+{
+    int k;
+    d->indexes |= which;
+    if (which & XDICT_INDEX_POSITIONS) {
+        for (k=0; k < XDICT_MAXLENGTH; ++k) {
+            if (d->posindex[k] != NULL || d->len[k] == 0) continue;
+            d->posindex[k] = xdict_build_posindex(d, k);
+            if (d->posindex[k] == NULL) return -3;
+        }
+    }
+    if (which & XDICT_INDEX_COLUMNS) {
+        for (k=0; k < XDICT_MAXLENGTH; ++k) {
+            if (d->columns[k] != NULL || d->len[k] == 0) continue;
+            d->columns[k] = xdict_build_columns(d, k);
+            if (d->columns[k] == NULL) return -3;
+        }
+    }
+    if ((which & XDICT_INDEX_TRIE) && d->trie == NULL && d->sorted) {
+        d->trie = xdict_build_trie(d);
+        if (d->trie == NULL) return -3;
+    }
+    if ((which & XDICT_INDEX_ANAGRAMS) && d->anagrams == NULL) {
+        d->anagrams = xdict_build_anagrams(d);
+        if (d->anagrams == NULL) return -3;
+    }
+    if (which & XDICT_INDEX_HASH) {
+        for (k=0; k < XDICT_MAXLENGTH; ++k) {
+            if (d->hash[k] != NULL || d->len[k] == 0) continue;
+            d->hash[k] = xdict_build_hash(d, k);
+            if (d->hash[k] == NULL) return -3;
+        }
+    }
+    if (which & XDICT_INDEX_SCORES) {
+        for (k=0; k < XDICT_MAXLENGTH; ++k) {
+            if (d->byscore[k] != NULL || d->len[k] == 0) continue;
+            d->byscore[k] = xdict_build_byscore(d, k);
+            if (d->byscore[k] == NULL) return -3;
+        }
+    }
+    if (which & XDICT_INDEX_SUFFIXES) {
+        for (k=0; k < XDICT_MAXLENGTH; ++k) {
+            if (d->bysuffix[k] != NULL || d->len[k] == 0) continue;
+            d->bysuffix[k] = xdict_build_bysuffix(d, k);
+            if (d->bysuffix[k] == NULL) return -3;
+        }
+    }
+    if (which & XDICT_INDEX_LETTERS) {
+        for (k=0; k < XDICT_MAXLENGTH; ++k) {
+            if (d->lettersets[k] != NULL || d->len[k] == 0) continue;
+            if (d->lettermasks[k] == NULL)
+              d->lettermasks[k] = xdict_build_lettermasks(d, k);
+            if (d->lettermasks[k] == NULL) return -3;
+            d->lettersets[k] = xdict_build_lettersets(d, k, d->lettermasks[k]);
+            if (d->lettersets[k] == NULL) return -3;
+        }
+    }
+    return 0;
+}
+
+/*
+   Bucket |k| is about to change; throw away everything we've derived
+   from its contents.
+*/
+static void xdict_touch(struct xdict *d, int k)
+{
+    xdict_free_posindex(d->posindex[k]);
+    d->posindex[k] = NULL;
+    xdict_free_columns(d->columns[k]);
+    d->columns[k] = NULL;
+    xdict_free_trie(d->trie);
+    d->trie = NULL;
+    xdict_free_anagrams(d->anagrams);
+    d->anagrams = NULL;
+    xdict_free_hash(d->hash[k]);
+    d->hash[k] = NULL;
+    xdict_free_byscore(d->byscore[k]);
+    d->byscore[k] = NULL;
+    free(d->bysuffix[k]);
+    d->bysuffix[k] = NULL;
+    free(d->lettermasks[k]);
+    d->lettermasks[k] = NULL;
+    xdict_free_lettersets(d->lettersets[k]);
+    d->lettersets[k] = NULL;
+    xdict_free_ladder(d->ladder[k]);
+    d->ladder[k] = NULL;
+    xdict_cache_drop(d, k);
+}
+
+static int xdict_ctz64(uint64_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    while (!(x & 1)) { x >>= 1; ++n; }
+    return n;
+#endif
+}
+
+static int xdict_popcount64(uint64_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(x);
+#else
+    int n = 0;
+    for ( ; x != 0; x &= x-1) ++n;
+    return n;
+#endif
+}
+
+/*
+   Answer the fixed-length pattern |pat| using the positional index for
+   bucket |len|, building it if necessary. A position allowing several
+   letters gets the OR of their bitmaps. Positions that allow non-letters
+   aren't indexed, so the words that survive the bitmaps are checked by
+   hand. Returns -2 if the index can't help (no constrained positions)
+   or can't be built, in which case the caller should fall back to a
+   linear scan.
+*/
+static int xdict_find_posindex(struct xdict *d, size_t len,
+                               const struct xdict_pattern *pat,
+                               int (*f)(const char *, void *), void *info)
+{
+    const uint64_t *bitmaps[XDICT_MAXLENGTH][26];
+    int nbitmaps[XDICT_MAXLENGTH];
+    struct xdict_posindex *x;
+    int npositions = 0;
+    int verify = 0;
+    int count = 0;
+    size_t p, b;
+
+    if (d->posindex[len] == NULL) {
+        d->posindex[len] = xdict_build_posindex(d, len);
+        if (d->posindex[len] == NULL) return -2;
+    }
+    x = d->posindex[len];
+
+    for (p=0; p < len; ++p) {
+        uint32_t m = pat->masks[p];
+        int n = 0;
+        if (m == XDICT_ANY) continue;
+        if ((m & XDICT_OTHER) || pat->lits[p]) {
+            verify = 1;
+            continue;
+        }
+        if (m == XDICT_VOWELS)
+          bitmaps[npositions][n++] = posindex_bitmap(x, p, POSINDEX_VOWEL);
+        else if (m == XDICT_CONSONANTS)
+          bitmaps[npositions][n++] = posindex_bitmap(x, p, POSINDEX_CONSONANT);
+        else {
+            int ch;
+            for (ch=0; ch < 26; ++ch) {
+                if (m & (1u << ch))
+                  bitmaps[npositions][n++] = posindex_bitmap(x, p, ch);
+            }
+        }
+        nbitmaps[npositions++] = n;
+    }
+    if (npositions == 0) return -2;
+
+    for (b=0; b < x->nblocks; ++b) {
+        uint64_t m = ~(uint64_t)0;
+        int j, q;
+        for (j=0; m != 0 && j < npositions; ++j) {
+            uint64_t any = 0;
+            for (q=0; q < nbitmaps[j]; ++q)
+              any |= bitmaps[j][q][b];
+            m &= any;
+        }
+        if (f == NULL && !verify) {
+            count += xdict_popcount64(m);
+            continue;
+        }
+        while (m != 0) {
+            size_t i = b*64 + xdict_ctz64(m);
+            const char *w = xdict_word(d, len, i);
+            m &= m-1;
+            if (verify && !xdict_pattern_match(pat, w, len)) continue;
+            ++count;
+            if (f && xdict_report(w, len, f, info)) return count;
+        }
+    }
+    return count;
+}
+
+
+#if XDICT_SIMD
+/*
+   Each constrained position of a pattern becomes one |simd_op|. The
+   op compares the column against up to 13 bytes and ORs the results.
+   With |invert| it then complements them, so a class of many letters
+   is tested as "none of the few letters it excludes". |letters| is +1
+   to also require a lowercase letter, -1 to also accept any byte that
+   isn't one.
+*/
+struct simd_op {
+    size_t offset;  /* of this position's column */
+    int neq;
+    unsigned char eq[13];
+    int invert;
+    int letters;
+};
+
+static int xdict_simd_plan(const struct xdict_pattern *pat, size_t npad,
+                           struct simd_op *ops)
+{
+    int p, ch, nops = 0;
+    for (p=0; p < pat->len; ++p) {
+        uint32_t m = pat->masks[p];
+        uint32_t letters = m & XDICT_LETTERS;
+        struct simd_op *op = &ops[nops];
+        int pop = 0;
+        if (m == XDICT_ANY) continue;
+        op->offset = p * npad;
+        op->neq = 0;
+        op->invert = 0;
+        op->letters = 0;
+        if (pat->lits[p]) {
+            op->eq[op->neq++] = pat->lits[p];
+            ++nops;
+            continue;
+        }
+        for (ch=0; ch < 26; ++ch)
+          pop += (letters >> ch) & 1;
+        if (pop > 13) {
+            letters ^= XDICT_LETTERS;
+            op->invert = 1;
+        }
+        for (ch=0; ch < 26; ++ch) {
+            if (letters & (1u << ch))
+              op->eq[op->neq++] = 'a' + ch;
+        }
+        if (m & XDICT_OTHER)
+          op->letters = op->invert? 0: -1;
+        else
+          op->letters = op->invert? +1: 0;
+        ++nops;
+    }
+    return nops;
+}
+
+/*
+   Both kernels fill |out[b]| with a bit for each of the 32 words in
+   block |first+b| that satisfies every op. They differ only in
+   vector width.
+*/
+__attribute__((target("sse2")))
+static void xdict_columns_sse2(const unsigned char *cols, const struct simd_op *ops,
+                               int nops, size_t first, size_t nblocks, uint32_t *out)
+{
+    const __m128i ones = _mm_set1_epi8(-1);
+    const __m128i bias = _mm_set1_epi8((char)0x80);
+    const __m128i below_a = _mm_set1_epi8(('a'-1) - 128);
+    const __m128i above_z = _mm_set1_epi8(('z'+1) - 128);
+    __m128i keys[XDICT_MAXLENGTH][13];
+    size_t b;
+    int j, q;
+
+    for (j=0; j < nops; ++j) {
+        for (q=0; q < ops[j].neq; ++q)
+          keys[j][q] = _mm_set1_epi8((char)ops[j].eq[q]);
+    }
+    for (b=0; b < nblocks; ++b) {
+        uint32_t result = 0;
+        int half;
+        for (half=0; half < 2; ++half) {
+            size_t i = (first + b)*32 + half*16;
+            __m128i acc = ones;
+            for (j=0; j < nops; ++j) {
+                const struct simd_op *op = &ops[j];
+                __m128i v = _mm_loadu_si128((const __m128i *)(cols + op->offset + i));
+                __m128i m = _mm_setzero_si128();
+                for (q=0; q < op->neq; ++q)
+                  m = _mm_or_si128(m, _mm_cmpeq_epi8(v, keys[j][q]));
+                if (op->invert)
+                  m = _mm_xor_si128(m, ones);
+                if (op->letters) {
+                    __m128i x = _mm_xor_si128(v, bias);
+                    __m128i isletter = _mm_and_si128(_mm_cmpgt_epi8(x, below_a),
+                                                     _mm_cmpgt_epi8(above_z, x));
+                    if (op->letters > 0)
+                      m = _mm_and_si128(m, isletter);
+                    else
+                      m = _mm_or_si128(m, _mm_xor_si128(isletter, ones));
+                }
+                acc = _mm_and_si128(acc, m);
+            }
+            result |= (uint32_t)_mm_movemask_epi8(acc) << (16*half);
+        }
+        out[b] = result;
+    }
+}
+
+__attribute__((target("avx2")))
+static void xdict_columns_avx2(const unsigned char *cols, const struct simd_op *ops,
+                               int nops, size_t first, size_t nblocks, uint32_t *out)
+{
+    const __m256i ones = _mm256_set1_epi8(-1);
+    const __m256i bias = _mm256_set1_epi8((char)0x80);
+    const __m256i below_a = _mm256_set1_epi8(('a'-1) - 128);
+    const __m256i above_z = _mm256_set1_epi8(('z'+1) - 128);
+    __m256i keys[XDICT_MAXLENGTH][13];
+    size_t b;
+    int j, q;
+
+    for (j=0; j < nops; ++j) {
+        for (q=0; q < ops[j].neq; ++q)
+          keys[j][q] = _mm256_set1_epi8((char)ops[j].eq[q]);
+    }
+    for (b=0; b < nblocks; ++b) {
+        size_t i = (first + b)*32;
+        __m256i acc = ones;
+        for (j=0; j < nops; ++j) {
+            const struct simd_op *op = &ops[j];
+            __m256i v = _mm256_loadu_si256((const __m256i *)(cols + op->offset + i));
+            __m256i m = _mm256_setzero_si256();
+            for (q=0; q < op->neq; ++q)
+              m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, keys[j][q]));
+            if (op->invert)
+              m = _mm256_xor_si256(m, ones);
+            if (op->letters) {
+                __m256i x = _mm256_xor_si256(v, bias);
+                __m256i isletter = _mm256_and_si256(_mm256_cmpgt_epi8(x, below_a),
+                                                    _mm256_cmpgt_epi8(above_z, x));
+                if (op->letters > 0)
+                  m = _mm256_and_si256(m, isletter);
+                else
+                  m = _mm256_or_si256(m, _mm256_xor_si256(isletter, ones));
+            }
+            acc = _mm256_and_si256(acc, m);
+        }
+        out[b] = (uint32_t)_mm256_movemask_epi8(acc);
+    }
+}
+
+/* Returns 2 for AVX2, 1 for SSE2, or 0 for neither. */
+static int xdict_simd_level(void)
+{
+    static int level = -1;
+    if (level < 0) {
+        __builtin_cpu_init();
+        level = __builtin_cpu_supports("avx2")? 2:
+                __builtin_cpu_supports("sse2")? 1: 0;
+    }
+    return level;
+}
+#endif
+
+/*
+   Answer the fixed-length pattern |pat| by a vectorized scan of the
+   columnar copy of bucket |len|, building it if necessary. Returns -2
+   if that isn't possible, in which case the caller should fall back
+   to a linear scan.
+*/
+static int xdict_find_columns(struct xdict *d, size_t len,
+                              const struct xdict_pattern *pat,
+                              int (*f)(const char *, void *), void *info)
+{
+#if XDICT_SIMD
+    struct simd_op ops[XDICT_MAXLENGTH];
+    uint32_t masks[64];
+    struct xdict_columns *x;
+    size_t b, nblocks, n = d->len[len];
+    int level = xdict_simd_level();
+    int nops, count = 0;
+
+    if (level == 0) return -2;
+    if (d->columns[len] == NULL) {
+        d->columns[len] = xdict_build_columns(d, len);
+        if (d->columns[len] == NULL) return -2;
+    }
+    x = d->columns[len];
+    nops = xdict_simd_plan(pat, x->npad, ops);
+    if (nops == 0) return -2;
+
+    nblocks = x->npad / 32;
+    for (b=0; b < nblocks; b += 64) {
+        size_t j, batch = (nblocks - b < 64)? nblocks - b: 64;
+        if (level == 2)
+          xdict_columns_avx2(x->bytes, ops, nops, b, batch, masks);
+        else
+          xdict_columns_sse2(x->bytes, ops, nops, b, batch, masks);
+        for (j=0; j < batch; ++j) {
+            uint32_t m = masks[j];
+            if (f == NULL) {
+                size_t lo = (b+j)*32;
+                if (lo + 32 > n)
+                  m &= (lo < n)? (1u << (n - lo)) - 1: 0;  /* padding */
+                count += xdict_popcount64(m);
+                continue;
+            }
+            while (m != 0) {
+                size_t i = (b+j)*32 + xdict_ctz64(m);
+                m &= m-1;
+                if (i >= n) break;  /* padding */
+                ++count;
+                if (f && xdict_report(xdict_word(d, len, i), len, f, info))
+                  return count;
+            }
+        }
+    }
+    return count;
+#else
+    return -2;
+#endif
+}
+
+/*
+   Walk the trie with the pattern as a nondeterministic automaton.
+   State |g| means "positions 0 through |g|-1 of |pat| have been
+   matched"; a '*' just before position |g| lets state |g| consume any
+   character and stay put. All the live states fit in one bitmask, so
+   each trie edge costs a table lookup and a shift. Since the nodes are
+   in preorder, the walk is a single forward sweep, remembering the
+   states at each depth of the current path; a prefix that kills every
+   state skips straight past its subtree.
+*/
+static void xdict_trie_search(const struct xdict_trie *t,
+                              const struct xdict_pattern *pat,
+                              uint64_t **hits)
+{
+    const struct xdict_trie_node *nodes = t->nodes;
+    uint32_t step[256];  /* states that may advance over each character */
+    uint32_t stars = 0;  /* states that may stay put over any character */
+    uint32_t accept = 1u << pat->len;
+    uint32_t states[XDICT_MAXLENGTH+1];
+    uint32_t c;
+    int g, ch;
+
+    for (g=1; g < pat->nsegs; ++g)
+      stars |= 1u << pat->seg[g];
+    for (ch=0; ch < 256; ++ch) {
+        step[ch] = 0;
+        for (g=0; g < pat->len; ++g) {
+            if (!(pat->masks[g] & xdict_charbit(ch))) continue;
+            if (pat->lits[g] && pat->lits[g] != ch) continue;
+            step[ch] |= 1u << g;
+        }
+    }
+
+    states[0] = 1;
+    c = 1;
+    while (c < t->len) {
+        const struct xdict_trie_node *n = &nodes[c];
+        uint32_t s = states[n->depth - 1];
+        uint32_t next = ((s & step[n->ch]) << 1) | (s & stars);
+        if (next == 0) {
+            c = n->next;
+            continue;
+        }
+        states[n->depth] = next;
+        if (n->word >= 0 && (next & accept))
+          hits[n->depth][n->word / 64] |= (uint64_t)1 << (n->word % 64);
+        ++c;
+    }
+}
+
+/*
+   Index lookups that visit the words out of order collect their
+   matches as one bitmap per length, then report them in the usual
+   order: by length, then by position in the bucket.
+*/
+static uint64_t *xdict_alloc_hits(const struct xdict *d, uint64_t **hits)
+{
+    size_t nblocks = 0;
+    uint64_t *bits;
+    int k;
+    for (k=0; k < XDICT_MAXLENGTH; ++k)
+      nblocks += (d->len[k] + 63) / 64;
+    bits = calloc(nblocks + 1, sizeof *bits);
+    if (bits == NULL) return NULL;
+    nblocks = 0;
+    for (k=0; k < XDICT_MAXLENGTH; ++k) {
+        hits[k] = bits + nblocks;
+        nblocks += (d->len[k] + 63) / 64;
+    }
+    return bits;
+}
+
+static int xdict_report_hits(struct xdict *d, uint64_t **hits,
+                             int from, int to,
+                             int (*f)(const char *, void *), void *info)
+{
+    int count = 0;
+    int k;
+    size_t b;
+    for (k=from; k < to; ++k) {
+        size_t nb = (d->len[k] + 63) / 64;
+        for (b=0; b < nb; ++b) {
+            uint64_t m = hits[k][b];
+            if (f == NULL) {
+                count += xdict_popcount64(m);
+                continue;
+            }
+            while (m != 0) {
+                size_t i = b*64 + xdict_ctz64(m);
+                m &= m-1;
+                ++count;
+                if (f && xdict_report(xdict_word(d, k, i), k, f, info))
+                  return count;
+            }
+        }
+    }
+    return count;
+}
+
+static int xdict_find_trie(struct xdict *d, const struct xdict_pattern *pat,
+                           int (*f)(const char *, void *), void *info)
+{
+    uint64_t *hits[XDICT_MAXLENGTH];
+    uint64_t *bits;
+    int count;
+
+    if (d->trie == NULL) {
+        if (!d->sorted) return -2;
+        d->trie = xdict_build_trie(d);
+        if (d->trie == NULL) return -2;
+    }
+    bits = xdict_alloc_hits(d, hits);
+    if (bits == NULL) return -2;
+    xdict_trie_search(d->trie, pat, hits);
+    count = xdict_report_hits(d, hits, pat->len, XDICT_MAXLENGTH, f, info);
+    free(bits);
+    return count;
+}
+
+/*
+   Fuzzy search: the distance between two words is the number of
+   letters that must be inserted, deleted or changed to turn one into
+   the other. Row |t| of the usual Levenshtein table holds the distance
+   from the |t|-letter prefix of a candidate to each prefix of |word|;
+   it depends only on row |t|-1 and the |t|th letter, so candidates
+   sharing a prefix share those rows. Once no entry of a row is within
+   |maxdist|, no later row can be either, and no word with that prefix
+   can match. |xdict_fuzzy_row| computes row |t| into |row| and
+   returns its smallest entry.
+*/
+static int xdict_fuzzy_row(const unsigned char *up, unsigned char *row, int t,
+                           int ch, const char *word, int m)
+{
+    int j, best = t;
+    row[0] = t;
+    for (j=1; j <= m; ++j) {
+        int x = up[j-1] + ((unsigned char)word[j-1] != ch);
+        if (up[j]+1 < x) x = up[j]+1;
+        if (row[j-1]+1 < x) x = row[j-1]+1;
+        row[j] = x;
+        if (x < best) best = x;
+    }
+    return best;
+}
+
+/*
+   On the trie, the rows for the current path are kept by depth, and a
+   hopeless prefix skips straight past its subtree.
+*/
+static void xdict_trie_fuzzy(const struct xdict_trie *t, const char *word,
+                             int m, int maxdist, uint64_t **hits)
+{
+    const struct xdict_trie_node *nodes = t->nodes;
+    unsigned char rows[XDICT_MAXLENGTH+1][XDICT_MAXLENGTH+1];
+    uint32_t c;
+    int j;
+
+    for (j=0; j <= m; ++j)
+      rows[0][j] = j;
+    c = 1;
+    while (c < t->len) {
+        const struct xdict_trie_node *n = &nodes[c];
+        unsigned char *row = rows[n->depth];
+        if (xdict_fuzzy_row(rows[n->depth-1], row, n->depth, n->ch, word, m) > maxdist) {
+            c = n->next;
+            continue;
+        }
+        if (n->word >= 0 && row[m] <= maxdist)
+          hits[n->depth][n->word / 64] |= (uint64_t)1 << (n->word % 64);
+        ++c;
+    }
+}
+
+/*
+   Without the trie, walk each bucket in order, reusing the rows for
+   the prefix each word shares with the one before it; in a sorted
+   bucket that is most of them.
+*/
+static int xdict_scan_fuzzy(struct xdict *d, const char *word, int m,
+                            int maxdist, int from, int to,
+                            int (*f)(const char *, void *), void *info)
+{
+    unsigned char rows[XDICT_MAXLENGTH+1][XDICT_MAXLENGTH+1];
+    int count = 0;
+    int j, k;
+
+    for (j=0; j <= m; ++j)
+      rows[0][j] = j;
+    for (k=from; k < to; ++k) {
+        const char *prev = NULL;
+        int valid = 0;   /* rows 0 through |valid| are those of |prev| */
+        int dead = -1;   /* the row at which |prev| was ruled out */
+        size_t i;
+        for (i=0; i < d->len[k]; ++i) {
+            const char *w = xdict_word(d, k, i);
+            int t = 0;
+            if (prev != NULL)
+              while (t < valid && w[t] == prev[t]) ++t;
+            prev = w;
+            if (dead >= 0 && t >= dead) {
+                valid = dead;
+                continue;
+            }
+            dead = -1;
+            for ( ; t < k; ++t) {
+                if (xdict_fuzzy_row(rows[t], rows[t+1], t+1,
+                                    (unsigned char)w[t], word, m) > maxdist) {
+                    dead = t+1;
+                    break;
+                }
+            }
+            valid = (dead >= 0)? dead: k;
+            if (dead < 0 && rows[k][m] <= maxdist) {
+                ++count;
+                if (f && xdict_report(w, k, f, info)) return count;
+            }
+        }
+    }
+    return count;
+}
+
+/*
+   When both indexes are available, pick the cheaper one for |pat|.
+   Per 64 words, the positional index loads one bitmap for each letter
+   a position allows (vowels and consonants have their own bitmaps),
+   while the vector scan makes two passes of roughly one compare per
+   letter allowed or excluded, whichever is fewer.
+*/
+static int xdict_prefer_posindex(const struct xdict_pattern *pat)
+{
+    int i, ch, bitmap_cost = 0, vector_cost = 0;
+    for (i=0; i < pat->len; ++i) {
+        uint32_t m = pat->masks[i];
+        int pop = 0;
+        if (m == XDICT_ANY) continue;
+        for (ch=0; ch < 26; ++ch)
+          pop += (m >> ch) & 1;
+        if (m == XDICT_VOWELS || m == XDICT_CONSONANTS)
+          bitmap_cost += 1;
+        else if (!(m & XDICT_OTHER) && !pat->lits[i])
+          bitmap_cost += pop;
+        vector_cost += 2 * ((pop > 13? 26-pop: pop) + 1);
+    }
+    return bitmap_cost <= vector_cost;
+}
+
+
+/*
+   With more than one thread (see |xdict_set_threads|), a long scan is
+   split into chunks of |XDICT_CHUNK| words, which the workers claim
+   in order. The chunk size is a multiple of 64, so no two chunks share
+   a word of the hit bitmaps. The calling thread reports each chunk's
+   matches as soon as it and every chunk before it are done. The
+   callback thus always runs on the caller's thread and sees the
+   matches in the usual order; when it asks to stop, the workers
+   abandon the chunks they haven't started.
+*/
+#define XDICT_CHUNK 8192
+#define XDICT_MINPARALLEL 32768  /* shorter scans aren't worth it */
+
+typedef int (*xdict_test_fn)(const char *w, size_t k, const void *arg);
+
+static int xdict_test_fixed(const char *w, size_t k, const void *arg)
+{
+    return xdict_pattern_match_at(arg, 0, k, w);
+}
+
+static int xdict_test_pattern(const char *w, size_t k, const void *arg)
+{
+    return xdict_pattern_match(arg, w, k);
+}
+
+#ifndef XDICT_NO_THREADS
+struct xdict_chunk {
+    int k;
+    size_t lo, hi;
+    int done;
+};
+
+struct xdict_scan {
+    struct xdict *d;
+    xdict_test_fn test;
+    const void *arg;
+    uint64_t *hits[XDICT_MAXLENGTH];
+    struct xdict_chunk *chunks;
+    int nchunks;
+    int next;
+    int cancel;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+static void *xdict_scan_worker(void *p)
+{
+    struct xdict_scan *s = p;
+    for (;;) {
+        struct xdict_chunk *c;
+        const char *w;
+        size_t i;
+        pthread_mutex_lock(&s->lock);
+        if (s->cancel || s->next == s->nchunks) {
+            pthread_mutex_unlock(&s->lock);
+            return NULL;
+        }
+        c = &s->chunks[s->next++];
+        pthread_mutex_unlock(&s->lock);
+        w = xdict_word(s->d, c->k, c->lo);
+        for (i=c->lo; i < c->hi; ++i, w += c->k) {
+            if (s->test(w, c->k, s->arg))
+              s->hits[c->k][i / 64] |= (uint64_t)1 << (i % 64);
+        }
+        pthread_mutex_lock(&s->lock);
+        c->done = 1;
+        pthread_cond_signal(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+#endif
+
+/*
+   Scan lengths |from| through |to|-1 in parallel, reporting the words
+   that pass |test|. Return -2 if the scan should be done serially
+   instead.
+*/
+static int xdict_scan_parallel(struct xdict *d, int from, int to,
+                               xdict_test_fn test, const void *arg,
+                               int (*f)(const char *, void *), void *info)
+{
+#ifndef XDICT_NO_THREADS
+    pthread_t tids[64];
+    struct xdict_scan s;
+    uint64_t *bits;
+    size_t total = 0, lo;
+    int nthreads = 0;
+    int count = 0, stop = 0;
+    int k, c;
+
+    if (d->threads < 2) return -2;
+    s.nchunks = 0;
+    for (k=from; k < to; ++k) {
+        total += d->len[k];
+        s.nchunks += (d->len[k] + XDICT_CHUNK-1) / XDICT_CHUNK;
+    }
+    if (total < XDICT_MINPARALLEL) return -2;
+
+    s.chunks = malloc(s.nchunks * sizeof *s.chunks);
+    if (s.chunks == NULL) return -2;
+    bits = xdict_alloc_hits(d, s.hits);
+    if (bits == NULL) {
+        free(s.chunks);
+        return -2;
+    }
+    c = 0;
+    for (k=from; k < to; ++k) {
+        for (lo=0; lo < d->len[k]; lo += XDICT_CHUNK, ++c) {
+            s.chunks[c].k = k;
+            s.chunks[c].lo = lo;
+            s.chunks[c].hi = (d->len[k] - lo < XDICT_CHUNK)? d->len[k]: lo + XDICT_CHUNK;
+            s.chunks[c].done = 0;
+        }
+    }
+    s.d = d;
+    s.test = test;
+    s.arg = arg;
+    s.next = 0;
+    s.cancel = 0;
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.cond, NULL);
+    while (nthreads < d->threads && nthreads < s.nchunks &&
+           nthreads < (int)(sizeof tids / sizeof *tids)) {
+        if (pthread_create(&tids[nthreads], NULL, xdict_scan_worker, &s) != 0)
+          break;
+        ++nthreads;
+    }
+    if (nthreads == 0) {
+        count = -2;
+        goto done;
+    }
+
+    for (c=0; c < s.nchunks && !stop; ++c) {
+        const struct xdict_chunk *ch = &s.chunks[c];
+        size_t b;
+        pthread_mutex_lock(&s.lock);
+        while (!ch->done)
+          pthread_cond_wait(&s.cond, &s.lock);
+        pthread_mutex_unlock(&s.lock);
+        for (b = ch->lo / 64; b < (ch->hi + 63) / 64 && !stop; ++b) {
+            uint64_t m = s.hits[ch->k][b];
+            if (f == NULL) {
+                count += xdict_popcount64(m);
+                continue;
+            }
+            while (m != 0) {
+                size_t i = b*64 + xdict_ctz64(m);
+                m &= m-1;
+                ++count;
+                if (f && xdict_report(xdict_word(d, ch->k, i), ch->k, f, info)) {
+                    stop = 1;
+                    break;
+                }
+            }
+        }
+    }
+    pthread_mutex_lock(&s.lock);
+    s.cancel = 1;
+    pthread_mutex_unlock(&s.lock);
+    while (nthreads > 0)
+      pthread_join(tids[--nthreads], NULL);
+  done:
+    pthread_cond_destroy(&s.cond);
+    pthread_mutex_destroy(&s.lock);
+    free(bits);
+    free(s.chunks);
+    return count;
+#else
+    return -2;
+#endif
+}
+
+/*
+   Set |*at| to the ordinal of |word| in bucket |k| and return 1, or
+   return 0 if it isn't there.
+*/
+static int xdict_ordinal(struct xdict *d, const char *word, int k, size_t *at)
+{
+    size_t i;
+    if ((d->indexes & XDICT_INDEX_HASH) && d->len[k] != 0) {
+        if (d->hash[k] == NULL)
+          d->hash[k] = xdict_build_hash(d, k);
+        if (d->hash[k] != NULL) {
+            const struct xdict_hash *x = d->hash[k];
+            size_t h = xdict_hashword(word, k) & x->mask;
+            for ( ; x->slots[h] != 0; h = (h+1) & x->mask) {
+                if (memcmp(xdict_word(d, k, x->slots[h]-1), word, k) == 0) {
+                    *at = x->slots[h]-1;
+                    return 1;
+                }
+            }
+            return 0;
+        }
+    }
+    if (d->sorted)
+      return xdict_search(d, word, k, at);
+    for (i=0; i < d->len[k]; ++i) {
+        if (memcmp(xdict_word(d, k, i), word, k) == 0) {
+            *at = i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+   Is |word| in the dictionary? With the hash index this takes constant
+   time; otherwise it's a binary search, or a scan if the dictionary
+   isn't sorted.
+*/
+int xdict_contains(struct xdict *d, const char *word, int k)
+{
+    size_t i;
+    if (k == 0) k = strlen(word);
+    if (k >= XDICT_MAXLENGTH) return 0;
+    return xdict_ordinal(d, word, k, &i);
+}
+
+
+int xdict_find(struct xdict *d, const char *pattern,
+               int (*f)(const char *, void *), void *info)
+{
+    struct xdict_pattern pat;
+    int rc = xdict_compile_pattern(&pat, pattern);
+    if (rc == -2 && strchr(pattern, '*') != NULL) return 0;
+    if (rc != 0) return -1;
+    return xdict_find_pattern(d, &pat, f, info);
+}
+
+/*
+   Return the number of words matching |pattern|, or -1 if it is
+   malformed. This is |xdict_find| without a callback: where an index
+   applies, the matches are counted a bitmap word at a time without
+   looking at the words themselves.
+*/
+int xdict_count(struct xdict *d, const char *pattern)
+{
+    return xdict_find(d, pattern, NULL, NULL);
+}
+
+/*
+   Run the searches for all |n| of |patterns| in a single pass over
+   the dictionary, calling |f| with the index of the pattern and the
+   word for each match; if |f| returns nonzero, that pattern's search
+   stops. The matches for each pattern arrive in the usual order, but
+   interleaved with those of the others. If |counts| isn't NULL, set
+   |counts[i]| to the number of matches of pattern |i|, or to -1 if it
+   is malformed. Return 0, or -3 if we run out of memory.
+
+     The fixed-length patterns of each length are tested together, up
+   to 64 at a time: for each position |p| and character |ch|, the bit
+   |allow[p][ch]| says which patterns of the batch let |ch| appear in
+   position |p|, so ANDing together one entry per position tests the
+   word against the whole batch at once.
+*/
+struct xdict_batch {
+    int which[64];
+    uint64_t live;
+    int npos;
+    int pos[XDICT_MAXLENGTH];
+    uint64_t allow[XDICT_MAXLENGTH][256];
+};
+
+int xdict_find_many(struct xdict *d, const char *const *patterns, int n,
+                    int *counts,
+                    int (*f)(int, const char *, void *), void *info)
+{
+    struct xdict_pattern *pats;
+    struct xdict_batch *batches = NULL;
+    int *found, *starred;
+    char buf[XDICT_MAXLENGTH];
+    int nstarred = 0;
+    int i, k;
+
+    pats = malloc(n * sizeof *pats + 2 * n * sizeof(int) + 1);
+    if (pats == NULL) return -3;
+    found = (int *)(pats + n);
+    starred = found + n;
+    for (i=0; i < n; ++i) {
+        int rc = xdict_compile_pattern(&pats[i], patterns[i]);
+        found[i] = 0;
+        if (rc == -2 && strchr(patterns[i], '*') != NULL)
+          pats[i].len = XDICT_MAXLENGTH;  /* can't match anything */
+        else if (rc != 0 || (pats[i].nsegs == 1 && pats[i].len < 2))
+          found[i] = -1;
+        if (found[i] == 0 && pats[i].nsegs > 1)
+          starred[nstarred++] = i;
+    }
+
+    for (k=0; k < XDICT_MAXLENGTH; ++k) {
+        const char *w = d->words[k];
+        size_t wi, nw = d->len[k];
+        int nbatches = 0, b, s, m = 0;
+
+        if (nw == 0) continue;
+        for (i=0; i < n; ++i)
+          m += (found[i] >= 0 && pats[i].nsegs == 1 && pats[i].len == k);
+        if (m > 0) {
+            void *t = realloc(batches, ((m+63)/64) * sizeof *batches);
+            if (t == NULL) {
+                free(batches);
+                free(pats);
+                return -3;
+            }
+            batches = t;
+        }
+        for (i=0; i < n; ++i) {
+            struct xdict_batch *x;
+            int p, ch, bit;
+            if (found[i] < 0 || pats[i].nsegs != 1 || pats[i].len != k) continue;
+            if (nbatches == 0 || batches[nbatches-1].live == ~(uint64_t)0) {
+                x = &batches[nbatches++];
+                x->live = 0;
+                x->npos = 0;
+                for (p=0; p < k; ++p) {
+                    for (ch=0; ch < 256; ++ch)
+                      x->allow[p][ch] = ~(uint64_t)0;
+                }
+            }
+            x = &batches[nbatches-1];
+            bit = xdict_popcount64(x->live);
+            x->which[bit] = i;
+            x->live |= (uint64_t)1 << bit;
+            for (p=0; p < k; ++p) {
+                uint32_t mask = pats[i].masks[p];
+                int lit = pats[i].lits[p];
+                if (mask == XDICT_ANY && !lit) continue;
+                for (ch=0; ch < 256; ++ch) {
+                    if (!(mask & xdict_charbit(ch)) || (lit && lit != ch))
+                      x->allow[p][ch] &= ~((uint64_t)1 << bit);
+                }
+            }
+        }
+        for (b=0; b < nbatches; ++b) {
+            struct xdict_batch *x = &batches[b];
+            int p, ch;
+            for (p=0; p < k; ++p) {
+                for (ch=0; ch < 256 && (x->allow[p][ch] & x->live) == x->live; ++ch) ;
+                if (ch < 256)
+                  x->pos[x->npos++] = p;
+            }
+        }
+
+        for (wi=0; wi < nw; ++wi, w += k) {
+            for (b=0; b < nbatches; ++b) {
+                const struct xdict_batch *x = &batches[b];
+                uint64_t hit = x->live;
+                int j;
+                for (j=0; hit != 0 && j < x->npos; ++j)
+                  hit &= x->allow[x->pos[j]][(unsigned char)w[x->pos[j]]];
+                while (hit != 0) {
+                    int bit = xdict_ctz64(hit);
+                    hit &= hit-1;
+                    i = x->which[bit];
+                    found[i] += 1;
+                    if (f == NULL) continue;
+                    memcpy(buf, w, k);
+                    buf[k] = '\0';
+                    if (f(i, buf, info))
+                      batches[b].live &= ~((uint64_t)1 << bit);
+                }
+            }
+            for (s=0; s < nstarred; ++s) {
+                i = starred[s];
+                if (i < 0 || pats[i].len > k || !xdict_pattern_match(&pats[i], w, k))
+                  continue;
+                found[i] += 1;
+                if (f == NULL) continue;
+                memcpy(buf, w, k);
+                buf[k] = '\0';
+                if (f(i, buf, info))
+                  starred[s] = -1;
+            }
+        }
+    }
+
+    if (counts != NULL)
+      memcpy(counts, found, n * sizeof *counts);
+    free(batches);
+    free(pats);
+    return 0;
+}
+
+/*
+   As |xdict_find|, but skip the words scoring less than |minscore|.
+*/
+int xdict_find_min(struct xdict *d, const char *pattern, int minscore,
+                   int (*f)(const char *, void *), void *info)
+{
+    struct xdict_pattern pat;
+    int rc = xdict_compile_pattern(&pat, pattern);
+    if (rc == -2 && strchr(pattern, '*') != NULL) return 0;
+    if (rc != 0) return -1;
+    return xdict_find_pattern_min(d, &pat, minscore, f, info);
+}
+
+/*
+   If every position of the fixed-length pattern |pat| allows exactly
+   one letter, spell out that word in |buf| and return 1.
+*/
+static int xdict_pattern_is_word(const struct xdict_pattern *pat, char *buf)
+{
+    int i, ch;
+    for (i=0; i < pat->len; ++i) {
+        uint32_t m = pat->masks[i];
+        if ((m & XDICT_OTHER) || (m & (m-1))) return 0;
+        for (ch=0; !(m & 1); m >>= 1) ++ch;
+        buf[i] = 'a' + ch;
+    }
+    return 1;
+}
+
+/*
+   If position |i| of |pat| allows just one character, set |*ch| to it
+   and return 1.
+*/
+static int xdict_pattern_letter(const struct xdict_pattern *pat, int i,
+                                char *ch)
+{
+    uint32_t m = pat->masks[i];
+    int c;
+    if (pat->lits[i] != 0) {
+        *ch = pat->lits[i];
+        return 1;
+    }
+    if ((m & XDICT_OTHER) || (m & (m-1))) return 0;
+    for (c=0; !(m & 1); m >>= 1) ++c;
+    *ch = 'a' + c;
+    return 1;
+}
+
+/* Compare the last |n| letters of |w|, read backward, with |rev|. */
+static int xdict_cmp_reversed(const char *w, int k, const char *rev, int n)
+{
+    int j;
+    for (j=0; j < n; ++j) {
+        unsigned char a = w[k-1-j], b = rev[j];
+        if (a != b) return (a < b)? -1: 1;
+    }
+    return 0;
+}
+
+/*
+   A pattern such as "pre*", "*ing" or "un*ed" pins down the first or
+   last few letters of its matches. In a sorted bucket the words with a
+   given prefix are one contiguous range, found by binary search, and
+   the suffix index does the same for the words with a given suffix;
+   so we need test only the words in both ranges, walking whichever is
+   the shorter. Matches found through the suffix index are collected
+   in a bitmap to be reported in order. Return -2 if the pattern pins
+   down no letters at either end, or we run out of memory.
+*/
+static int xdict_find_affix(struct xdict *d, const struct xdict_pattern *pat,
+                            int (*f)(const char *, void *), void *info)
+{
+    char prefix[XDICT_MAXLENGTH], suffix[XDICT_MAXLENGTH];
+    int plen = 0, slen = 0;
+    int last = pat->nsegs-1;
+    int to = (pat->nsegs == 1)? pat->len+1: XDICT_MAXLENGTH;
+    uint64_t *bits = NULL;
+    int count = 0;
+    int k;
+
+    while (plen < pat->seg[1] && xdict_pattern_letter(pat, plen, &prefix[plen]))
+      ++plen;
+    while (slen < pat->len - pat->seg[last] &&
+           xdict_pattern_letter(pat, pat->len-1-slen, &suffix[slen]))
+      ++slen;
+    if (!d->sorted || (plen == 0 && slen == 0)) return -2;
+    if (slen > 0) {
+        size_t maxn = 0;
+        for (k=pat->len; k < to; ++k) {
+            if (d->len[k] == 0) continue;
+            if (d->bysuffix[k] == NULL)
+              d->bysuffix[k] = xdict_build_bysuffix(d, k);
+            if (d->bysuffix[k] == NULL) return -2;
+            if (d->len[k] > maxn) maxn = d->len[k];
+        }
+        bits = calloc((maxn + 63) / 64 + 1, sizeof *bits);
+        if (bits == NULL) return -2;
+    }
+
+    for (k=pat->len; k < to; ++k) {
+        size_t lo = 0, hi = d->len[k];
+        size_t slo = 0, shi = 0;
+        size_t i, j;
+        if (hi == 0) continue;
+        if (plen > 0) {
+            size_t a = 0, b = hi;
+            while (a < b) {
+                size_t mid = a + (b-a)/2;
+                if (memcmp(xdict_word(d, k, mid), prefix, plen) < 0) a = mid+1;
+                else b = mid;
+            }
+            lo = a;
+            for (b = hi; a < b; ) {
+                size_t mid = a + (b-a)/2;
+                if (memcmp(xdict_word(d, k, mid), prefix, plen) <= 0) a = mid+1;
+                else b = mid;
+            }
+            hi = a;
+        }
+        if (lo == hi) continue;
+        if (slen > 0) {
+            const uint32_t *ord = d->bysuffix[k];
+            size_t a = 0, b = d->len[k];
+            while (a < b) {
+                size_t mid = a + (b-a)/2;
+                if (xdict_cmp_reversed(xdict_word(d, k, ord[mid]), k, suffix, slen) < 0) a = mid+1;
+                else b = mid;
+            }
+            slo = a;
+            for (b = d->len[k]; a < b; ) {
+                size_t mid = a + (b-a)/2;
+                if (xdict_cmp_reversed(xdict_word(d, k, ord[mid]), k, suffix, slen) <= 0) a = mid+1;
+                else b = mid;
+            }
+            shi = a;
+            if (slo == shi) continue;
+        }
+        if (slen == 0 || hi - lo <= shi - slo) {
+            for (i=lo; i < hi; ++i) {
+                const char *w = xdict_word(d, k, i);
+                if (xdict_pattern_match(pat, w, k)) {
+                    ++count;
+                    if (f && xdict_report(w, k, f, info)) break;
+                }
+            }
+            if (i < hi) break;
+            continue;
+        }
+        for (j=slo; j < shi; ++j) {
+            i = d->bysuffix[k][j];
+            if (lo <= i && i < hi && xdict_pattern_match(pat, xdict_word(d, k, i), k))
+              bits[i / 64] |= (uint64_t)1 << (i % 64);
+        }
+        for (j = lo/64; j <= (hi-1)/64; ++j) {
+            uint64_t m = bits[j];
+            bits[j] = 0;
+            if (f == NULL) {
+                count += xdict_popcount64(m);
+                continue;
+            }
+            while (m != 0) {
+                i = j*64 + xdict_ctz64(m);
+                m &= m-1;
+                ++count;
+                if (xdict_report(xdict_word(d, k, i), k, f, info)) {
+                    free(bits);
+                    return count;
+                }
+            }
+        }
+    }
+    free(bits);
+    return count;
+}
+
+static int xdict_find_matches(struct xdict *d, const struct xdict_pattern *pat,
+                              int (*f)(const char *, void *), void *info)
+{
+    int count = 0;
+    char word[XDICT_MAXLENGTH];
+
+    if (pat->nsegs == 1) {
+        size_t len = pat->len;
+        const char *w;
+
+        if (len < 2) return -1;
+        w = d->words[len];
+
+        if (d->sorted && xdict_pattern_is_word(pat, word)) {
+            /*
+               If the dictionary is sorted and the pattern is
+               simply a word, we can look it up directly instead
+               of our usual slow linear search.
+            */
+            if (!xdict_contains(d, word, len)) return 0;
+            if (f != NULL)
+              xdict_report(word, len, f, info);
+            return 1;
+        }
+        else {
+            size_t i, n = d->len[len];
+            if ((d->indexes & XDICT_INDEX_POSITIONS) &&
+                (!(d->indexes & XDICT_INDEX_COLUMNS) || xdict_prefer_posindex(pat))) {
+                int rc = xdict_find_posindex(d, len, pat, f, info);
+                if (rc != -2) return rc;
+            }
+            if (d->indexes & XDICT_INDEX_COLUMNS) {
+                int rc = xdict_find_columns(d, len, pat, f, info);
+                if (rc != -2) return rc;
+            }
+            {
+                int rc = xdict_find_affix(d, pat, f, info);
+                if (rc != -2) return rc;
+            }
+            {
+                int rc = xdict_scan_parallel(d, len, len+1, xdict_test_fixed,
+                                             pat, f, info);
+                if (rc != -2) return rc;
+            }
+            for (i=0; i < n; ++i, w += len) {
+                if (xdict_pattern_match_at(pat, 0, len, w)) {
+                    ++count;
+                    if (f && xdict_report(w, len, f, info)) return count;
+                }
+            }
+            return count;
+        }
+    }
+    else {
+        size_t k;
+        int last = pat->nsegs-1;
+        {
+            int rc = xdict_find_affix(d, pat, f, info);
+            if (rc != -2) return rc;
+        }
+        /*
+           The trie can't prune anything until the pattern's first
+           literal, so a pattern like "*ing" is cheaper to check
+           against the end of each word directly.
+        */
+        if ((d->indexes & XDICT_INDEX_TRIE) && pat->len > 0 &&
+            (pat->seg[1] > 0 || pat->seg[last] == pat->len)) {
+            int rc = xdict_find_trie(d, pat, f, info);
+            if (rc != -2) return rc;
+        }
+        {
+            int rc = xdict_scan_parallel(d, pat->len, XDICT_MAXLENGTH,
+                                         xdict_test_pattern, pat, f, info);
+            if (rc != -2) return rc;
+        }
+        for (k=pat->len; k < XDICT_MAXLENGTH; ++k) {
+            const char *w = d->words[k];
+            size_t i, n = d->len[k];
+            for (i=0; i < n; ++i, w += k) {
+                if (xdict_pattern_match(pat, w, k)) {
+                    ++count;
+                    if (f && xdict_report(w, k, f, info)) return count;
+                }
+            }
+        }
+        return count;
+    }
+}
+
+/*
+   Only the words at the front of each bucket's score index can score
+   at least |minscore|, so test just those, collect the matches in the
+   hit bitmaps, and report them in the usual order. When the threshold
+   is high, this looks at a small fraction of the dictionary. If we
+   can't get the memory for that, check the score of each match of a
+   plain scan instead.
+*/
+static int xdict_find_scored(struct xdict *d, const struct xdict_pattern *pat,
+                             int minscore,
+                             int (*f)(const char *, void *), void *info)
+{
+    uint64_t *hits[XDICT_MAXLENGTH];
+    uint64_t *bits;
+    int from = pat->len;
+    int to = (pat->nsegs == 1)? pat->len+1: XDICT_MAXLENGTH;
+    int count = 0;
+    int k;
+
+    if (minscore <= 0)
+      return xdict_find_matches(d, pat, f, info);
+    if (pat->nsegs == 1 && pat->len < 2) return -1;
+    if (minscore > XDICT_MAXSCORE) return 0;
+
+    bits = xdict_alloc_hits(d, hits);
+    for (k=from; k < to && bits != NULL; ++k) {
+        const struct xdict_byscore *x;
+        size_t j, n;
+        if (d->len[k] == 0) continue;
+        if (d->byscore[k] == NULL)
+          d->byscore[k] = xdict_build_byscore(d, k);
+        if (d->byscore[k] == NULL) {
+            free(bits);
+            bits = NULL;
+            break;
+        }
+        x = d->byscore[k];
+        n = x->atleast[minscore];
+        for (j=0; j < n; ++j) {
+            uint32_t i = x->ordinals[j];
+            const char *w = xdict_word(d, k, i);
+            if (pat->nsegs == 1? xdict_pattern_match_at(pat, 0, k, w):
+                                 xdict_pattern_match(pat, w, k))
+              hits[k][i / 64] |= (uint64_t)1 << (i % 64);
+        }
+    }
+    if (bits != NULL) {
+        count = xdict_report_hits(d, hits, from, to, f, info);
+        free(bits);
+        return count;
+    }
+
+    for (k=from; k < to; ++k) {
+        const char *w = d->words[k];
+        size_t i, n = d->len[k];
+        for (i=0; i < n; ++i, w += k) {
+            if (xdict_score(d, k, i) < minscore) continue;
+            if (xdict_pattern_match(pat, w, k)) {
+                ++count;
+                if (f && xdict_report(w, k, f, info)) return count;
+            }
+        }
+    }
+    return count;
+}
+
+static int xdict_match_scrabble(const char *w, size_t n, const int *mincounts, const int *maxcounts)
+{
+    int counts[256] = {0};
+    for (size_t i=0; i < n; ++i) {
+        int ch = (unsigned char)w[i];
         if (counts[ch] < maxcounts[ch]) {
             counts[ch] += 1;
         } else if (is_vowel(w[i]) && counts['0'] < maxcounts['0']) {
@@ -332,38 +3535,1191 @@ static int xdict_match_scrabble(const char *w, const int *mincounts, const int *
             return 0;
         }
     }
-    for (int ch = 0; ch < 256; ++ch) {
-        if (counts[ch] < mincounts[ch]) {
-            return 0;
+    for (int ch = 0; ch < 256; ++ch) {
+        if (counts[ch] < mincounts[ch]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+   Letters a rack can't supply from its own tiles must come from its
+   wildcards: the pure vowels from '0' or '?', the pure consonants
+   from '1' or '?', 'y' from any of the three, and anything else only
+   from '?'. Can the rack's wildcards cover the shortfall |n|?
+*/
+struct xdict_shortfall {
+    int vowels, consonants, ys, others;
+};
+
+static int xdict_rack_covers(const struct xdict_shortfall *n, const int *maxcounts)
+{
+    int vowels = maxcounts['0'] - n->vowels;
+    int consonants = maxcounts['1'] - n->consonants;
+    int blanks = maxcounts['?'] - n->others;
+    if (vowels < 0) { blanks += vowels; vowels = 0; }
+    if (consonants < 0) { blanks += consonants; consonants = 0; }
+    if (n->ys > vowels + consonants)
+      blanks -= n->ys - vowels - consonants;
+    return blanks >= 0;
+}
+
+/*
+   Walk the anagram index for every signature the rack could spell.
+   Along a path the letters are in sorted order, so the number of
+   copies of the newest letter is the length of the run it ends, and
+   the shortfall grows by one whenever that run outgrows the rack.
+   Once the wildcards can't cover it, nothing below can be spelled
+   either. (Word characters that are themselves '0', '1' or '?' are
+   never held against the rack here.) Each word in a surviving group
+   is still checked with |xdict_match_scrabble|, so the results are
+   exactly those of the full scan.
+*/
+static int xdict_find_anagrams(struct xdict *d,
+                               const int *mincounts, const int *maxcounts,
+                               size_t minlen, size_t maxlen,
+                               int (*f)(const char *, void *), void *info)
+{
+    struct xdict_shortfall need[XDICT_MAXLENGTH+1];
+    unsigned char path[XDICT_MAXLENGTH+1];
+    int run[XDICT_MAXLENGTH+1];
+    const struct xdict_anagrams *x;
+    uint64_t *hits[XDICT_MAXLENGTH];
+    uint64_t *bits;
+    uint32_t c, j;
+    int count;
+
+    if (d->anagrams == NULL) {
+        d->anagrams = xdict_build_anagrams(d);
+        if (d->anagrams == NULL) return -2;
+    }
+    x = d->anagrams;
+    bits = xdict_alloc_hits(d, hits);
+    if (bits == NULL) return -2;
+
+    memset(&need[0], 0, sizeof need[0]);
+    c = 1;
+    while (c < x->trie.len) {
+        const struct xdict_trie_node *n = &x->trie.nodes[c];
+        size_t depth = n->depth;
+        int ch = n->ch;
+        if (depth >= maxlen) {
+            c = n->next;
+            continue;
+        }
+        need[depth] = need[depth-1];
+        run[depth] = (depth > 1 && path[depth-1] == ch)? run[depth-1]+1: 1;
+        path[depth] = ch;
+        if (run[depth] > maxcounts[ch] && ch != '0' && ch != '1' && ch != '?') {
+            uint32_t bit = xdict_charbit(ch);
+            if (ch == 'y') need[depth].ys += 1;
+            else if (bit & XDICT_VOWELS) need[depth].vowels += 1;
+            else if (bit & XDICT_CONSONANTS) need[depth].consonants += 1;
+            else need[depth].others += 1;
+            if (!xdict_rack_covers(&need[depth], maxcounts)) {
+                c = n->next;
+                continue;
+            }
+        }
+        if (n->word >= 0 && depth >= minlen) {
+            for (j = x->start[n->word]; j < x->start[n->word+1]; ++j) {
+                uint32_t i = x->ordinals[j];
+                if (xdict_match_scrabble(xdict_word(d, depth, i), depth,
+                                         mincounts, maxcounts))
+                  hits[depth][i / 64] |= (uint64_t)1 << (i % 64);
+            }
+        }
+        ++c;
+    }
+
+    count = xdict_report_hits(d, hits, minlen, maxlen, f, info);
+    free(bits);
+    return count;
+}
+
+struct xdict_rack {
+    const int *mincounts;
+    const int *maxcounts;
+};
+
+static int xdict_test_rack(const char *w, size_t k, const void *arg)
+{
+    const struct xdict_rack *r = arg;
+    return xdict_match_scrabble(w, k, r->mincounts, r->maxcounts);
+}
+
+static int xdict_find_rack(struct xdict *d, const char *rack, const char *mustuse,
+                           int (*f)(const char *, void *), void *info)
+{
+    int count = 0;
+    int mincounts[256] = {0};
+    int maxcounts[256] = {0};
+    for (int i = 0; rack[i] != '\0'; ++i) {
+        int ch = (unsigned char)rack[i];
+        maxcounts[ch] += 1;
+    }
+    for (int i = 0; mustuse[i] != '\0'; ++i) {
+        int ch = (unsigned char)mustuse[i];
+        mincounts[ch] += 1;
+    }
+    size_t minlen = strlen(mustuse) > 2 ? strlen(mustuse) : 2;
+    size_t maxlen = strlen(rack)+1 < XDICT_MAXLENGTH ? strlen(rack)+1 : XDICT_MAXLENGTH;
+    if (d->indexes & XDICT_INDEX_ANAGRAMS) {
+        int rc = xdict_find_anagrams(d, mincounts, maxcounts, minlen, maxlen, f, info);
+        if (rc != -2) return rc;
+    }
+    if (minlen < maxlen) {
+        struct xdict_rack r = { mincounts, maxcounts };
+        int rc = xdict_scan_parallel(d, minlen, maxlen, xdict_test_rack, &r, f, info);
+        if (rc != -2) return rc;
+    }
+    for (size_t len = minlen; len < maxlen; ++len) {
+        const char *w = d->words[len];
+        for (size_t i=0; i < d->len[len]; ++i, w += len) {
+            if (xdict_match_scrabble(w, len, mincounts, maxcounts)) {
+                ++count;
+                if (f && xdict_report(w, len, f, info)) return count;
+            }
+        }
+    }
+    return count;
+}
+
+
+/*
+   The search cache is a list of recent results, most recently used
+   first, holding at most |maxbytes| of them. Each entry is keyed on a
+   normal form of the search: the compiled pattern and score threshold,
+   so that "b0t" and "b[aeiouy]t" share an entry, or the sorted rack and
+   required letters. Its results are the ordinals of the matching
+   words, with the number found in each length bucket, so an entry is
+   good only until one of the buckets in |buckets| changes; see
+   |xdict_touch|. Only a sorted dictionary is cached, because we find
+   the ordinals by binary search.
+*/
+#define XDICT_CACHE_MAXKEY 128
+
+struct xdict_cacheentry {
+    struct xdict_cacheentry *prev, *next;
+    uint32_t hash;
+    size_t keylen;
+    unsigned char key[XDICT_CACHE_MAXKEY];
+    unsigned buckets;
+    uint32_t counts[XDICT_MAXLENGTH];
+    size_t n;
+    uint32_t *ordinals;
+};
+
+struct xdict_cache {
+    struct xdict_cacheentry *head, *tail;
+    size_t bytes, maxbytes;
+};
+
+static size_t xdict_cache_size(const struct xdict_cacheentry *e)
+{
+    return sizeof *e + e->n * sizeof *e->ordinals;
+}
+
+static void xdict_cache_unlink(struct xdict_cache *c, struct xdict_cacheentry *e)
+{
+    if (e->prev) e->prev->next = e->next; else c->head = e->next;
+    if (e->next) e->next->prev = e->prev; else c->tail = e->prev;
+}
+
+static void xdict_cache_push(struct xdict_cache *c, struct xdict_cacheentry *e)
+{
+    e->prev = NULL;
+    e->next = c->head;
+    if (c->head) c->head->prev = e; else c->tail = e;
+    c->head = e;
+}
+
+static void xdict_cache_evict(struct xdict_cache *c, struct xdict_cacheentry *e)
+{
+    xdict_cache_unlink(c, e);
+    c->bytes -= xdict_cache_size(e);
+    free(e->ordinals);
+    free(e);
+}
+
+/*
+   Remember the results of searches in up to |maxbytes| of memory, or
+   forget them all if |maxbytes| is zero.
+*/
+int xdict_set_cache(struct xdict *d, size_t maxbytes)
+{
+    struct xdict_cache *c = d->cache;
+    if (c == NULL && maxbytes > 0) {
+        c = malloc(sizeof *c);
+        if (c == NULL) return -3;
+        c->head = c->tail = NULL;
+        c->bytes = 0;
+        d->cache = c;
+    }
+    if (c == NULL) return 0;
+    c->maxbytes = maxbytes;
+    while (c->tail != NULL && c->bytes > maxbytes)
+      xdict_cache_evict(c, c->tail);
+    if (maxbytes == 0) {
+        free(c);
+        d->cache = NULL;
+    }
+    return 0;
+}
+
+/* Forget every result that depends on bucket |k|. */
+static void xdict_cache_drop(struct xdict *d, int k)
+{
+    struct xdict_cacheentry *e, *next;
+    if (d->cache == NULL) return;
+    for (e = d->cache->head; e != NULL; e = next) {
+        next = e->next;
+        if (e->buckets & (1u << k))
+          xdict_cache_evict(d->cache, e);
+    }
+}
+
+/*
+   A search, as the cache sees it: either the pattern |pat| with the
+   score threshold |minscore|, or the Scrabble |rack| and |mustuse|.
+*/
+struct xdict_query {
+    const struct xdict_pattern *pat;
+    int minscore;
+    const char *rack, *mustuse;
+};
+
+static int xdict_run_query(struct xdict *d, const struct xdict_query *q,
+                           int (*f)(const char *, void *), void *info)
+{
+    if (q->rack != NULL)
+      return xdict_find_rack(d, q->rack, q->mustuse, f, info);
+    return xdict_find_scored(d, q->pat, q->minscore, f, info);
+}
+
+/* Append the bytes of |s|, in order, to |key|; 0 if they don't fit. */
+static size_t xdict_key_letters(unsigned char *key, size_t at, const char *s)
+{
+    size_t counts[256] = {0};
+    int ch;
+    if (strlen(s) >= XDICT_CACHE_MAXKEY - at) return 0;
+    for ( ; *s != '\0'; ++s)
+      counts[(unsigned char)*s] += 1;
+    for (ch=1; ch < 256; ++ch) {
+        for ( ; counts[ch] > 0; --counts[ch])
+          key[at++] = ch;
+    }
+    key[at++] = '\0';
+    return at;
+}
+
+/*
+   Spell out the normal form of |q| in |key| and return its length, or
+   0 if it can't be cached. Set |*buckets| to the word lengths that
+   the search looks at.
+*/
+static size_t xdict_query_key(const struct xdict_query *q,
+                              unsigned char *key, unsigned *buckets)
+{
+    size_t at = 0;
+    int i, from, to;
+    if (q->rack != NULL) {
+        size_t n = strlen(q->rack), m = strlen(q->mustuse);
+        from = (m > 2)? m: 2;
+        to = (n+1 < XDICT_MAXLENGTH)? n+1: XDICT_MAXLENGTH;
+        key[at++] = 'R';
+        at = xdict_key_letters(key, at, q->rack);
+        if (at == 0) return 0;
+        at = xdict_key_letters(key, at, q->mustuse);
+        if (at == 0) return 0;
+    }
+    else {
+        const struct xdict_pattern *pat = q->pat;
+        /* Thresholds past either end all mean the same thing. */
+        int minscore = (q->minscore < 0)? 0:
+                       (q->minscore > XDICT_MAXSCORE)? XDICT_MAXSCORE+1: q->minscore;
+        from = pat->len;
+        to = (pat->nsegs == 1)? pat->len+1: XDICT_MAXLENGTH;
+        key[at++] = 'P';
+        key[at++] = minscore & 0xFF;
+        key[at++] = minscore >> 8;
+        key[at++] = pat->nsegs;
+        for (i=1; i < pat->nsegs; ++i)
+          key[at++] = pat->seg[i];
+        for (i=0; i < pat->len; ++i) {
+            uint32_t m = pat->masks[i];
+            key[at++] = m; key[at++] = m >> 8;
+            key[at++] = m >> 16; key[at++] = m >> 24;
+            key[at++] = pat->lits[i];
+        }
+    }
+    *buckets = 0;
+    for (i=from; i < to; ++i)
+      *buckets |= 1u << i;
+    return at;
+}
+
+/* Would the cache keep |n| results? See |xdict_cache_fill|. */
+static int xdict_cache_keeps(const struct xdict *d, size_t n)
+{
+    return d->cache != NULL &&
+        sizeof (struct xdict_cacheentry) + n * sizeof (uint32_t) <= d->cache->maxbytes / 4;
+}
+
+/*
+   Collect the ordinals of the words a search reports, passing each
+   word on to |f| as it goes. The words arrive by length and then in
+   order; if one doesn't, or isn't in the dictionary, or the results
+   grow too big for the cache to keep, the collection has |failed|,
+   but the search goes on. |stopped| is set if |f| asks to stop.
+*/
+struct xdict_collect {
+    struct xdict_locator loc;
+    uint32_t counts[XDICT_MAXLENGTH];
+    uint32_t *ordinals;
+    size_t n, cap;
+    int k;
+    size_t next;
+    int failed, stopped;
+    int (*f)(const char *, void *);
+    void *info;
+};
+
+static int xdict_collect(struct xdict_locator *loc, const char *w, int k,
+                         size_t i)
+{
+    struct xdict_collect *c = (struct xdict_collect *)loc;
+    if (!c->failed && (i == (size_t)-1 || k < c->k ||
+                       (k == c->k && i < c->next) ||
+                       !xdict_cache_keeps(loc->d, c->n + 1)))
+      c->failed = 1;
+    if (!c->failed && c->n == c->cap) {
+        size_t newcap = 2 * c->cap + 64;
+        void *t = realloc(c->ordinals, newcap * sizeof *c->ordinals);
+        if (t == NULL) {
+            c->failed = 1;
+        }
+        else {
+            c->ordinals = t;
+            c->cap = newcap;
         }
     }
-    return 1;
+    if (!c->failed) {
+        c->ordinals[c->n++] = i;
+        c->counts[k] += 1;
+        c->k = k;
+        c->next = i+1;
+    }
+    if (c->f == xdict_locate) {
+        struct xdict_locator *to = c->info;
+        c->stopped = to->found(to, w, k, i);
+    }
+    else {
+        c->stopped = xdict_report(w, k, c->f, c->info);
+    }
+    return c->stopped;
 }
 
-int xdict_find_scrabble(struct xdict *d, const char *rack, const char *mustuse,
+static int xdict_replay(struct xdict *d, const uint32_t *counts,
+                        const uint32_t *ordinals,
                         int (*f)(const char *, void *), void *info)
 {
     int count = 0;
-    int mincounts[256] = {0};
-    int maxcounts[256] = {0};
-    for (int i = 0; rack[i] != '\0'; ++i) {
-        int ch = (unsigned char)rack[i];
-        maxcounts[ch] += 1;
+    size_t j = 0;
+    int k;
+    uint32_t i;
+    if (f == NULL) {
+        for (k=0; k < XDICT_MAXLENGTH; ++k)
+          count += counts[k];
+        return count;
     }
-    for (int i = 0; mustuse[i] != '\0'; ++i) {
-        int ch = (unsigned char)mustuse[i];
-        mincounts[ch] += 1;
+    for (k=0; k < XDICT_MAXLENGTH; ++k) {
+        for (i=0; i < counts[k]; ++i) {
+            ++count;
+            if (f && xdict_report(xdict_word(d, k, ordinals[j++]), k, f, info))
+              return count;
+        }
     }
-    size_t minlen = strlen(mustuse) > 2 ? strlen(mustuse) : 2;
-    size_t maxlen = strlen(rack)+1 < XDICT_MAXLENGTH ? strlen(rack)+1 : XDICT_MAXLENGTH;
-    for (size_t len = minlen; len < maxlen; ++len) {
-        struct word_entry *w = d->words[len];
-        for (size_t i=0; i < d->len[len]; ++i) {
-            if (xdict_match_scrabble(w[i].word, mincounts, maxcounts)) {
+    return count;
+}
+
+/* Find |key| in the cache and move it to the front, or return NULL. */
+static struct xdict_cacheentry *xdict_cache_find(struct xdict_cache *c,
+                                                 const unsigned char *key,
+                                                 size_t keylen, uint32_t hash)
+{
+    struct xdict_cacheentry *e;
+    for (e = c->head; e != NULL; e = e->next) {
+        if (e->hash == hash && e->keylen == keylen &&
+            memcmp(e->key, key, keylen) == 0) {
+            xdict_cache_unlink(c, e);
+            xdict_cache_push(c, e);
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/*
+   Return the cached results of |q|, or NULL if they aren't there,
+   without counting a hit or a miss.
+*/
+static struct xdict_cacheentry *xdict_cache_lookup(struct xdict *d,
+                                                   const struct xdict_query *q)
+{
+    unsigned char key[XDICT_CACHE_MAXKEY];
+    unsigned buckets;
+    size_t keylen;
+    if (d->cache == NULL || !d->sorted) return NULL;
+    keylen = xdict_query_key(q, key, &buckets);
+    if (keylen == 0) return NULL;
+    return xdict_cache_find(d->cache, key, keylen,
+                            xdict_hashword((const char *)key, keylen));
+}
+
+/*
+   Run |q|, reporting its results to |f| as they are found and
+   remembering them, unless |f| stops the search early or they would
+   take up more than a quarter of the cache. This neither looks in the
+   cache first nor counts a miss.
+*/
+static int xdict_cache_fill(struct xdict *d, const struct xdict_query *q,
+                            int (*f)(const char *, void *), void *info)
+{
+    struct xdict_cache *c = d->cache;
+    struct xdict_cacheentry *e;
+    struct xdict_collect col;
+    unsigned char key[XDICT_CACHE_MAXKEY];
+    unsigned buckets;
+    size_t keylen = xdict_query_key(q, key, &buckets);
+    int rc;
+
+    if (keylen == 0)
+      return xdict_run_query(d, q, f, info);
+    memset(&col, 0, sizeof col);
+    col.loc.d = d;
+    col.loc.found = xdict_collect;
+    col.f = f;
+    col.info = info;
+    rc = xdict_run_query(d, q, xdict_locate, &col);
+    e = NULL;
+    if (rc >= 0 && !col.failed && !col.stopped)
+      e = malloc(sizeof *e);
+    if (e == NULL) {
+        free(col.ordinals);
+        return rc;
+    }
+    e->hash = xdict_hashword((const char *)key, keylen);
+    e->keylen = keylen;
+    memcpy(e->key, key, keylen);
+    e->buckets = buckets;
+    memcpy(e->counts, col.counts, sizeof e->counts);
+    e->n = col.n;
+    e->ordinals = col.ordinals;
+    c->bytes += xdict_cache_size(e);
+    xdict_cache_push(c, e);
+    while (c->bytes > c->maxbytes && c->tail != e)
+      xdict_cache_evict(c, c->tail);
+    return rc;
+}
+
+/* Answer |q| from the cache if we can, and otherwise fill it. */
+static int xdict_cached_query(struct xdict *d, const struct xdict_query *q,
+                              int (*f)(const char *, void *), void *info)
+{
+    struct xdict_cacheentry *e;
+    unsigned char key[XDICT_CACHE_MAXKEY];
+    unsigned buckets;
+    size_t keylen;
+
+    if (d->cache == NULL || !d->sorted)
+      return xdict_run_query(d, q, f, info);
+    keylen = xdict_query_key(q, key, &buckets);
+    if (keylen == 0)
+      return xdict_run_query(d, q, f, info);
+    e = xdict_cache_find(d->cache, key, keylen,
+                         xdict_hashword((const char *)key, keylen));
+    if (e != NULL) {
+        d->cache_hits += 1;
+        return xdict_replay(d, e->counts, e->ordinals, f, info);
+    }
+    d->cache_misses += 1;
+    /* A bare count is cheaper to get afresh than to collect. */
+    if (f == NULL)
+      return xdict_run_query(d, q, f, info);
+    return xdict_cache_fill(d, q, f, info);
+}
+
+int xdict_find_pattern(struct xdict *d, const struct xdict_pattern *pat,
+                       int (*f)(const char *, void *), void *info)
+{
+    return xdict_find_pattern_min(d, pat, 0, f, info);
+}
+
+int xdict_find_pattern_min(struct xdict *d, const struct xdict_pattern *pat,
+                           int minscore,
+                           int (*f)(const char *, void *), void *info)
+{
+    struct xdict_query q;
+    q.pat = pat;
+    q.minscore = minscore;
+    q.rack = q.mustuse = NULL;
+    return xdict_cached_query(d, &q, f, info);
+}
+
+int xdict_find_scrabble(struct xdict *d, const char *rack, const char *mustuse,
+                        int (*f)(const char *, void *), void *info)
+{
+    struct xdict_query q;
+    q.pat = NULL;
+    q.minscore = 0;
+    q.rack = rack;
+    q.mustuse = mustuse;
+    return xdict_cached_query(d, &q, f, info);
+}
+
+
+/*
+   Report the words within edit distance |maxdist| of |word|, in the
+   usual order. Return their number, or -1 if |word| is too long to
+   be a word or |maxdist| is negative.
+*/
+int xdict_find_fuzzy(struct xdict *d, const char *word, int maxdist,
+                     int (*f)(const char *, void *), void *info)
+{
+    size_t m = strlen(word);
+    int from, to;
+    if (m >= XDICT_MAXLENGTH || maxdist < 0) return -1;
+    if (maxdist >= XDICT_MAXLENGTH) maxdist = XDICT_MAXLENGTH-1;
+    from = ((int)m > maxdist)? m - maxdist: 0;
+    to = m + maxdist + 1;
+    if (to > XDICT_MAXLENGTH) to = XDICT_MAXLENGTH;
+
+    if ((d->indexes & XDICT_INDEX_TRIE) && d->trie == NULL && d->sorted)
+      d->trie = xdict_build_trie(d);
+    if ((d->indexes & XDICT_INDEX_TRIE) && d->trie != NULL) {
+        uint64_t *hits[XDICT_MAXLENGTH];
+        uint64_t *bits = xdict_alloc_hits(d, hits);
+        if (bits != NULL) {
+            int count;
+            xdict_trie_fuzzy(d->trie, word, m, maxdist, hits);
+            count = xdict_report_hits(d, hits, from, to, f, info);
+            free(bits);
+            return count;
+        }
+    }
+    return xdict_scan_fuzzy(d, word, m, maxdist, from, to, f, info);
+}
+
+
+/* Set |*m| to the letters of |s|, or return -1 if it has non-letters. */
+static int xdict_letterset_mask(const char *s, uint32_t *m)
+{
+    for (*m = 0; *s != '\0'; ++s) {
+        if (*s < 'a' || *s > 'z') return -1;
+        *m |= 1u << (*s - 'a');
+    }
+    return 0;
+}
+
+/*
+   Mark the words of bucket |k| whose masks fit, looking at whole
+   groups of the letter-set index. If there are few enough subsets of
+   |allow| containing |req|, look each one up by binary search among
+   the groups with that many letters; otherwise test every group with
+   an acceptable number of letters.
+*/
+static void xdict_letterset_groups(const struct xdict_lettersets *x,
+                                   uint32_t allow, uint32_t req,
+                                   uint64_t *hits)
+{
+    uint32_t free_bits = allow & ~req;
+    int lo = xdict_popcount64(req);
+    int hi = xdict_popcount64(allow);
+    int nfree = xdict_popcount64(free_bits);
+    size_t g, end = x->bypop[hi+1];
+    if (nfree < 20 && ((size_t)1 << nfree) < (end - x->bypop[lo]) / 16) {
+        uint32_t sub = free_bits;
+        for (;;) {
+            uint32_t m = req | sub;
+            int p = xdict_popcount64(m);
+            size_t a = x->bypop[p], b = x->bypop[p+1];
+            while (a < b) {
+                size_t mid = a + (b-a)/2;
+                if (x->masks[mid] < m) a = mid+1;
+                else b = mid;
+            }
+            if (a < x->bypop[p+1] && x->masks[a] == m) {
+                size_t j;
+                for (j = x->start[a]; j < x->start[a+1]; ++j)
+                  hits[x->ordinals[j] / 64] |= (uint64_t)1 << (x->ordinals[j] % 64);
+            }
+            if (sub == 0) break;
+            sub = (sub - 1) & free_bits;
+        }
+        return;
+    }
+    for (g = x->bypop[lo]; g < end; ++g) {
+        uint32_t m = x->masks[g];
+        if ((m & ~allow) == 0 && (m & req) == req) {
+            size_t j;
+            for (j = x->start[g]; j < x->start[g+1]; ++j)
+              hits[x->ordinals[j] / 64] |= (uint64_t)1 << (x->ordinals[j] % 64);
+        }
+    }
+}
+
+/*
+   Report the words that use no letters outside |allowed| (or any
+   letters at all, if |allowed| is NULL) and use every letter in
+   |required|, however many times. Return their number, or -1 if
+   either set has anything but lowercase letters.
+*/
+int xdict_find_letterset(struct xdict *d, const char *allowed,
+                         const char *required,
+                         int (*f)(const char *, void *), void *info)
+{
+    uint32_t allow = XDICT_ANY, req = 0;
+    int count = 0;
+    int k;
+
+    if (allowed != NULL && xdict_letterset_mask(allowed, &allow) != 0) return -1;
+    if (required != NULL && xdict_letterset_mask(required, &req) != 0) return -1;
+    if (req & ~allow) return 0;
+
+    if (d->indexes & XDICT_INDEX_LETTERS) {
+        uint64_t *hits[XDICT_MAXLENGTH];
+        uint64_t *bits = xdict_alloc_hits(d, hits);
+        for (k=0; k < XDICT_MAXLENGTH && bits != NULL; ++k) {
+            if (d->len[k] == 0) continue;
+            if (d->lettermasks[k] == NULL)
+              d->lettermasks[k] = xdict_build_lettermasks(d, k);
+            if (d->lettersets[k] == NULL && d->lettermasks[k] != NULL)
+              d->lettersets[k] = xdict_build_lettersets(d, k, d->lettermasks[k]);
+            if (d->lettersets[k] == NULL) {
+                free(bits);
+                bits = NULL;
+                break;
+            }
+            xdict_letterset_groups(d->lettersets[k], allow, req, hits[k]);
+        }
+        if (bits != NULL) {
+            count = xdict_report_hits(d, hits, 0, XDICT_MAXLENGTH, f, info);
+            free(bits);
+            return count;
+        }
+    }
+
+    for (k=0; k < XDICT_MAXLENGTH; ++k) {
+        const uint32_t *lm;
+        size_t i, n = d->len[k];
+        if (n == 0) continue;
+        if (d->lettermasks[k] == NULL)
+          d->lettermasks[k] = xdict_build_lettermasks(d, k);
+        lm = d->lettermasks[k];
+        for (i=0; i < n; ++i) {
+            const char *w = xdict_word(d, k, i);
+            uint32_t m;
+            if (lm != NULL)
+              m = lm[i];
+            else {
+                int p;
+                for (m = 0, p = 0; p < k; ++p)
+                  m |= xdict_charbit((unsigned char)w[p]);
+            }
+            if ((m & ~allow) == 0 && (m & req) == req) {
                 ++count;
-                if (f && f(w[i].word, info)) return count;
+                if (f && xdict_report(w, k, f, info)) return count;
             }
         }
     }
     return count;
 }
+
+
+/*
+   Ladder queries run a breadth-first search over the ladder graph of
+   the words' length, backward from |to|. |xdict_find_ladder| stops as
+   soon as it reaches |from|, and then follows the trail of parents
+   forward to |to|. |xdict_find_ladders| searches only |maxsteps| deep,
+   and then walks every path from |from| that never repeats a word and
+   never strays farther from |to| than the steps it has left. Either
+   way, a ladder is reported as one string, its words separated by
+   spaces.
+*/
+#define XDICT_FAR ((uint32_t)-1)
+
+static struct xdict_ladder *xdict_get_ladder(struct xdict *d, int k)
+{
+    if (d->ladder[k] == NULL)
+      d->ladder[k] = xdict_build_ladder(d, k);
+    return d->ladder[k];
+}
+
+static int xdict_report_ladder(const struct xdict *d, int k,
+                               const uint32_t *path, size_t len, char *buf,
+                               int (*f)(const char *, void *), void *info)
+{
+    size_t i;
+    for (i=0; i < len; ++i) {
+        memcpy(buf + i*(k+1), xdict_word(d, k, path[i]), k);
+        buf[i*(k+1) + k] = ' ';
+    }
+    buf[len*(k+1) - 1] = '\0';
+    return f(buf, info);
+}
+
+/*
+   Find the distance to |to| of every word within |maxsteps| steps of
+   it, stopping early once |from| is reached (unless |from| is
+   |XDICT_FAR|). Words not reached get |XDICT_FAR|.
+*/
+static void xdict_ladder_bfs(const struct xdict_ladder *x, size_t n,
+                               uint32_t to, uint32_t from, uint32_t maxsteps,
+                               uint32_t *dist, uint32_t *parent,
+                               uint32_t *queue)
+{
+    size_t i, head = 0, tail = 0;
+    for (i=0; i < n; ++i)
+      dist[i] = XDICT_FAR;
+    dist[to] = 0;
+    parent[to] = to;
+    queue[tail++] = to;
+    while (head < tail && (from == XDICT_FAR || dist[from] == XDICT_FAR)) {
+        uint32_t u = queue[head++], j;
+        if (dist[u] == maxsteps) break;
+        for (j = x->start[u]; j < x->start[u+1]; ++j) {
+            uint32_t v = x->adj[j];
+            if (dist[v] == XDICT_FAR) {
+                dist[v] = dist[u] + 1;
+                parent[v] = u;
+                queue[tail++] = v;
+            }
+        }
+    }
+}
+
+/*
+   Report a shortest ladder from |from| to |to|. Return 1 if there is
+   one, 0 if there isn't, -1 if either isn't a word in the dictionary
+   or their lengths differ, or -3 if we run out of memory.
+*/
+int xdict_find_ladder(struct xdict *d, const char *from, const char *to,
+                      int (*f)(const char *, void *), void *info)
+{
+    const struct xdict_ladder *x;
+    size_t k = strlen(from);
+    size_t a, b, n, len;
+    uint32_t *dist, *parent, *queue;
+    int rc = 0;
+
+    if (k == 0 || k >= XDICT_MAXLENGTH || strlen(to) != k) return -1;
+    if (!xdict_ordinal(d, from, k, &a) || !xdict_ordinal(d, to, k, &b))
+      return -1;
+    if ((x = xdict_get_ladder(d, k)) == NULL) return -3;
+    n = d->len[k];
+    dist = malloc(3 * n * sizeof *dist);
+    if (dist == NULL) return -3;
+    parent = dist + n;
+    queue = parent + n;
+
+    xdict_ladder_bfs(x, n, b, a, XDICT_FAR, dist, parent, queue);
+    if (dist[a] != XDICT_FAR) {
+        rc = 1;
+        len = dist[a] + 1;
+        if (f != NULL) {
+            char *buf = malloc(len * (k+1));
+            size_t i;
+            /* The BFS is done with |queue|, so the ladder can go there. */
+            queue[0] = a;
+            for (i=1; i < len; ++i)
+              queue[i] = parent[queue[i-1]];
+            if (buf == NULL)
+              rc = -3;
+            else
+              xdict_report_ladder(d, k, queue, len, buf, f, info);
+            free(buf);
+        }
+    }
+    free(dist);
+    return rc;
+}
+
+struct xdict_ladder_walk {
+    const struct xdict *d;
+    const struct xdict_ladder *x;
+    int k;
+    const uint32_t *dist;
+    unsigned char *onpath;
+    uint32_t *path;
+    uint32_t to, maxsteps;
+    char *buf;
+    int (*f)(const char *, void *);
+    void *info;
+    int count;
+    int stop;
+};
+
+static void xdict_walk_ladders(struct xdict_ladder_walk *w, uint32_t u,
+                               uint32_t steps)
+{
+    uint32_t j;
+    w->path[steps] = u;
+    if (u == w->to) {
+        w->count += 1;
+        if (w->f != NULL &&
+            xdict_report_ladder(w->d, w->k, w->path, steps+1, w->buf, w->f, w->info))
+          w->stop = 1;
+        return;
+    }
+    w->onpath[u] = 1;
+    for (j = w->x->start[u]; j < w->x->start[u+1] && !w->stop; ++j) {
+        uint32_t v = w->x->adj[j];
+        if (!w->onpath[v] && w->dist[v] != XDICT_FAR &&
+                steps + 1 + w->dist[v] <= w->maxsteps)
+          xdict_walk_ladders(w, v, steps+1);
+    }
+    w->onpath[u] = 0;
+}
+
+/*
+   Report every ladder from |from| to |to| of at most |maxsteps| steps
+   that doesn't use any word twice, and return how many there are (or
+   -1 or -3, as for |xdict_find_ladder|).
+*/
+int xdict_find_ladders(struct xdict *d, const char *from, const char *to,
+                       int maxsteps,
+                       int (*f)(const char *, void *), void *info)
+{
+    struct xdict_ladder_walk w;
+    size_t k = strlen(from);
+    size_t a, b, n;
+    uint32_t *dist, *parent;
+
+    if (k == 0 || k >= XDICT_MAXLENGTH || strlen(to) != k || maxsteps < 0)
+      return -1;
+    if (!xdict_ordinal(d, from, k, &a) || !xdict_ordinal(d, to, k, &b))
+      return -1;
+    if ((w.x = xdict_get_ladder(d, k)) == NULL) return -3;
+    n = d->len[k];
+    /* No ladder without a repeated word is longer than |n-1| steps. */
+    if ((size_t)maxsteps >= n) maxsteps = n-1;
+
+    dist = malloc(3 * n * sizeof *dist);
+    w.onpath = calloc(n, 1);
+    w.buf = malloc((maxsteps+1) * (k+1));
+    if (dist == NULL || w.onpath == NULL || w.buf == NULL) {
+        free(dist);
+        free(w.onpath);
+        free(w.buf);
+        return -3;
+    }
+    parent = dist + n;
+    w.path = parent + n;  /* after the BFS, reused for the path */
+    xdict_ladder_bfs(w.x, n, b, XDICT_FAR, maxsteps, dist, parent, w.path);
+
+    w.d = d;
+    w.k = k;
+    w.dist = dist;
+    w.to = b;
+    w.maxsteps = maxsteps;
+    w.f = f;
+    w.info = info;
+    w.count = 0;
+    w.stop = 0;
+    if (dist[a] != XDICT_FAR)
+      xdict_walk_ladders(&w, a, 0);
+    free(dist);
+    free(w.onpath);
+    free(w.buf);
+    return w.count;
+}
+
+
+/*
+   On a sorted dictionary the matches come from the usual search, so
+   that it can use the indexes and the cache, and a page of them is
+   what |xdict_cursor_page| below gathers. Only when the dictionary
+   isn't sorted do we fall back on testing every word as we go.
+*/
+int xdict_cursor_open(struct xdict_cursor *c, struct xdict *d,
+                      const char *pattern, int minscore)
+{
+    int rc = xdict_compile_pattern(&c->pat, pattern);
+    c->d = d;
+    c->minscore = minscore;
+    c->pos = 0;
+    c->i = 0;
+    c->total = 0;
+    if (rc == -2 && strchr(pattern, '*') != NULL) {
+        /* Too long to match anything. */
+        c->k = c->end = XDICT_MAXLENGTH;
+        return 0;
+    }
+    if (rc != 0) {
+        c->d = NULL;
+        return -1;
+    }
+    c->k = c->pat.len;
+    c->end = (c->pat.nsegs == 1)? c->pat.len+1: XDICT_MAXLENGTH;
+    rc = xdict_find_pattern_min(d, &c->pat, minscore, NULL, NULL);
+    if (rc < 0) {
+        c->d = NULL;
+        return rc;
+    }
+    c->total = rc;
+    if (rc == 0)
+      c->k = c->end;
+    return rc;
+}
+
+/*
+   Move |c| on to its next match, returning 0 if there are no more.
+   The match is then word |c->i - 1| of bucket |c->k|.
+*/
+static int xdict_cursor_step(struct xdict_cursor *c)
+{
+    const struct xdict *d = c->d;
+    for ( ; c->k < c->end; ++c->k, c->i = 0) {
+        int k = c->k;
+        size_t n = d->len[k];
+        while (c->i < n) {
+            size_t i = c->i++;
+            const char *w = xdict_word(d, k, i);
+            if (c->minscore > 0 && xdict_score(d, k, i) < c->minscore)
+              continue;
+            if (c->pat.nsegs == 1? xdict_pattern_match_at(&c->pat, 0, k, w):
+                                   xdict_pattern_match(&c->pat, w, k)) {
+                c->pos += 1;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+   A page of matches, as the search reports them through
+   |xdict_locate|. The search can't start part way through, so the
+   matches before the cursor are passed over; once the page is full,
+   the search is stopped, unless it must |finish| for the cache to
+   keep its results. If |words| is NULL the matches are only counted.
+*/
+struct xdict_page {
+    struct xdict_locator loc;
+    struct xdict_cursor *c;
+    char (*words)[XDICT_MAXLENGTH];
+    int n, max;
+    int finish;
+};
+
+static int xdict_page_found(struct xdict_locator *loc, const char *w, int k,
+                            size_t i)
+{
+    struct xdict_page *p = (struct xdict_page *)loc;
+    struct xdict_cursor *c = p->c;
+    if (p->n == p->max) return !p->finish;
+    if (i == (size_t)-1 || k < c->k || (k == c->k && i < c->i)) return 0;
+    if (p->words != NULL) {
+        memcpy(p->words[p->n], w, k);
+        p->words[p->n][k] = '\0';
+    }
+    c->k = k;
+    c->i = i+1;
+    c->pos += 1;
+    p->n += 1;
+    return (p->n == p->max && !p->finish);
+}
+
+/* Copy the next page of matches out of the cached results |e|. */
+static int xdict_cursor_copy(struct xdict_cursor *c,
+                             const struct xdict_cacheentry *e,
+                             char (*words)[XDICT_MAXLENGTH], int max)
+{
+    const struct xdict *d = c->d;
+    const uint32_t *ord = e->ordinals;
+    int k, n = 0;
+    for (k=0; k < c->k; ++k)
+      ord += e->counts[k];
+    while (c->k < c->end && n < max) {
+        size_t lo = 0, hi = e->counts[c->k];
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo)/2;
+            if (ord[mid] < c->i) lo = mid+1;
+            else hi = mid;
+        }
+        for ( ; lo < e->counts[c->k] && n < max; ++lo, ++n) {
+            if (words != NULL) {
+                memcpy(words[n], xdict_word(d, c->k, ord[lo]), c->k);
+                words[n][c->k] = '\0';
+            }
+            c->i = ord[lo] + 1;
+            c->pos += 1;
+        }
+        if (n == max) break;
+        ord += e->counts[c->k];
+        c->k += 1;
+        c->i = 0;
+    }
+    return n;
+}
+
+/*
+   Gather up to |max| more matches into |words| (if it isn't NULL)
+   and return how many there were. A search whose results the cache
+   has is read from there; otherwise, if the cache would keep them,
+   we run the search to the end so that it does, and if not, we stop
+   it at the end of the page.
+*/
+static int xdict_cursor_page(struct xdict_cursor *c,
+                             char (*words)[XDICT_MAXLENGTH], int max)
+{
+    struct xdict *d = c->d;
+    struct xdict_cacheentry *e;
+    struct xdict_query q;
+    struct xdict_page p;
+    int rc;
+
+    if (d == NULL || max <= 0 || c->k >= c->end) return 0;
+    if (!d->sorted) {
+        int n = 0;
+        while (n < max && xdict_cursor_step(c)) {
+            if (words != NULL) {
+                memcpy(words[n], xdict_word(d, c->k, c->i - 1), c->k);
+                words[n][c->k] = '\0';
+            }
+            ++n;
+        }
+        return n;
+    }
+    q.pat = &c->pat;
+    q.minscore = c->minscore;
+    q.rack = q.mustuse = NULL;
+    e = xdict_cache_lookup(d, &q);
+    if (e != NULL) {
+        p.n = xdict_cursor_copy(c, e, words, max);
+    }
+    else {
+        p.loc.d = d;
+        p.loc.found = xdict_page_found;
+        p.c = c;
+        p.words = words;
+        p.n = 0;
+        p.max = max;
+        p.finish = xdict_cache_keeps(d, c->total);
+        if (p.finish)
+          rc = xdict_cache_fill(d, &q, xdict_locate, &p);
+        else
+          rc = xdict_run_query(d, &q, xdict_locate, &p);
+        if (rc < 0) return rc;
+    }
+    if (p.n < max || c->pos >= c->total)
+      c->k = c->end;
+    return p.n;
+}
+
+int xdict_cursor_next(struct xdict_cursor *c,
+                      char (*words)[XDICT_MAXLENGTH], int max)
+{
+    return xdict_cursor_page(c, words, max);
+}
+
+/*
+   Seeking backward starts over from the beginning; seeking forward
+   just passes over matches without copying them. Return -1 if there
+   are fewer than |n| matches, leaving |c| at the end.
+*/
+int xdict_cursor_seek(struct xdict_cursor *c, size_t n)
+{
+    if (c->d == NULL) return -1;
+    if (n < c->pos) {
+        c->k = (c->total == 0)? c->end: c->pat.len;
+        c->i = 0;
+        c->pos = 0;
+    }
+    while (c->pos < n) {
+        size_t want = n - c->pos;
+        if (xdict_cursor_page(c, NULL, (want > INT_MAX)? INT_MAX: (int)want) <= 0)
+          return -1;
+    }
+    return 0;
+}
+
+void xdict_cursor_close(struct xdict_cursor *c)
+{
+    c->d = NULL;
+}
+
+
+int xdict_wordset_init(struct xdict_wordset *s, size_t maxwords, size_t maxchars)
+{
+    size_t size = 16;
+    while (size < 2*maxwords) size *= 2;
+    s->mask = size-1;
+    s->slots = calloc(size, sizeof *s->slots);
+    s->textcap = maxchars + maxwords;
+    s->text = malloc(s->textcap + 1);
+    s->textlen = 0;
+    s->len = 0;
+    s->maxwords = maxwords;
+    if (s->slots == NULL || s->text == NULL) {
+        xdict_wordset_free(s);
+        return -3;
+    }
+    return 0;
+}
+
+void xdict_wordset_clear(struct xdict_wordset *s)
+{
+    memset(s->slots, 0, (s->mask+1) * sizeof *s->slots);
+    s->textlen = 0;
+    s->len = 0;
+}
+
+/*
+   Find the slot holding |word|, or the empty slot where it would go.
+*/
+static size_t xdict_wordset_probe(const struct xdict_wordset *s,
+                                  const char *word, int k)
+{
+    size_t h = xdict_hashword(word, k) & s->mask;
+    for ( ; s->slots[h] != 0; h = (h+1) & s->mask) {
+        const char *t = s->text + s->slots[h] - 1;
+        if ((unsigned char)t[0] == k && memcmp(t+1, word, k) == 0)
+          break;
+    }
+    return h;
+}
+
+int xdict_wordset_add(struct xdict_wordset *s, const char *word, int k)
+{
+    size_t h;
+    if (k == 0) k = strlen(word);
+    if (k > 255) return -1;
+    h = xdict_wordset_probe(s, word, k);
+    if (s->slots[h] != 0) return 1;
+    if (s->len == s->maxwords || s->textlen + 1 + k > s->textcap)
+      return -3;
+    s->slots[h] = s->textlen + 1;
+    s->text[s->textlen] = k;
+    memcpy(s->text + s->textlen + 1, word, k);
+    s->textlen += 1 + k;
+    s->len += 1;
+    return 0;
+}
+
+int xdict_wordset_contains(const struct xdict_wordset *s, const char *word, int k)
+{
+    if (k == 0) k = strlen(word);
+    if (k > 255) return 0;
+    return s->slots[xdict_wordset_probe(s, word, k)] != 0;
+}
+
+void xdict_wordset_free(struct xdict_wordset *s)
+{
+    free(s->slots);
+    free(s->text);
+    s->slots = NULL;
+    s->text = NULL;
+}
@@ -2,6 +2,7 @@
 #ifndef H_XDICTLIB
  #define H_XDICTLIB
 
+#include <stdint.h>
 #include <stdlib.h>
 
 #ifdef __cplusplus
@@ -14,32 +15,201 @@ extern "C" {
 
 #define XDICT_MAXLENGTH 16  /* 0..15 characters */
 
+/*
+   The words of each length |k| are stored back to back in the single
+   array |words[k]|, with a stride of |k| bytes and no terminating nulls.
+   Use |xdict_word(d, k, i)| to find the |i|th word of length |k|.
+   A dictionary opened with |xdict_open_mapped| points its buckets into
+   the read-only |map| until they are modified.
+
+   Each word also has a score from 0 to |XDICT_MAXSCORE|, kept in the
+   parallel array |scores[k]|; a word list that gives none scores every
+   word |XDICT_DEFAULT_SCORE|. Use |xdict_score(d, k, i)| to read it.
+   Higher scores mean better fill. |scored| is set once any score has
+   been given explicitly, and tells |xdict_save| to write them out.
+
+   The optional |cache| remembers the results of recent searches (see
+   |xdict_set_cache|); |cache_hits| and |cache_misses| count how often
+   it could answer a search and how often it couldn't.
+
+   The |indexes| are optional search structures requested by the client
+   via |xdict_build_index|. Each is kept per length bucket (the trie
+   and the anagram index span all of them), thrown away when that
+   bucket is modified, and rebuilt when next needed. The word-ladder
+   graph of a bucket is likewise kept in |ladder|, but it is built
+   only when a ladder query first needs it.
+*/
+#define XDICT_INDEX_POSITIONS 0x1  /* per-position letter bitmaps */
+#define XDICT_INDEX_COLUMNS   0x2  /* transposed copy for vector scans */
+#define XDICT_INDEX_TRIE      0x4  /* prefix trie for '*' patterns */
+#define XDICT_INDEX_ANAGRAMS  0x8  /* words grouped by sorted letters */
+#define XDICT_INDEX_HASH      0x10 /* hash table for |xdict_contains| */
+#define XDICT_INDEX_SCORES    0x20 /* words ordered by score */
+#define XDICT_INDEX_SUFFIXES  0x40 /* words ordered by their reversals */
+#define XDICT_INDEX_LETTERS   0x80 /* words grouped by the letters they use */
+
+#define XDICT_MAXSCORE 255
+#define XDICT_DEFAULT_SCORE 50
+
 struct xdict {
-    struct word_entry *words[XDICT_MAXLENGTH];
+    char *words[XDICT_MAXLENGTH];
+    unsigned char *scores[XDICT_MAXLENGTH];
     size_t cap[XDICT_MAXLENGTH];
     size_t len[XDICT_MAXLENGTH];
     int sorted;
+    int scored;
+    void *map;
+    size_t maplen;
+    int indexes;
+    struct xdict_posindex *posindex[XDICT_MAXLENGTH];
+    struct xdict_columns *columns[XDICT_MAXLENGTH];
+    struct xdict_trie *trie;
+    struct xdict_anagrams *anagrams;
+    struct xdict_hash *hash[XDICT_MAXLENGTH];
+    struct xdict_byscore *byscore[XDICT_MAXLENGTH];
+    uint32_t *bysuffix[XDICT_MAXLENGTH];
+    uint32_t *lettermasks[XDICT_MAXLENGTH];
+    struct xdict_lettersets *lettersets[XDICT_MAXLENGTH];
+    struct xdict_ladder *ladder[XDICT_MAXLENGTH];
+    int threads;
+    struct xdict_cache *cache;
+    unsigned long cache_hits, cache_misses;
+};
+
+#define xdict_word(d, k, i) ((d)->words[k] + (size_t)(i)*(k))
+#define xdict_score(d, k, i) \
+    ((d)->scores[k] != NULL? (d)->scores[k][i]: XDICT_DEFAULT_SCORE)
+
+
+/*
+   A pattern such as "c?t*[^s]" can be compiled once into a program of
+   per-position letter-class masks: bit |i| of a mask allows the letter
+   |'a'+i|, and bit 26 allows any character that isn't a lowercase
+   letter. A position holding such a character literally also records
+   it in |lits|. The '*' wildcards split the positions into |nsegs|
+   segments; segment |s| covers |masks[seg[s]]| up to |masks[seg[s+1]]|.
+   A pattern without '*' is a single segment of fixed length |len|.
+*/
+#define XDICT_LETTERS    0x3FFFFFFu
+#define XDICT_OTHER      0x4000000u
+#define XDICT_ANY        (XDICT_LETTERS | XDICT_OTHER)
+#define XDICT_VOWELS     0x1104111u  /* aeiouy */
+#define XDICT_CONSONANTS 0x3EFBEEEu  /* bcdfghjklmnpqrstvwxyz */
+
+struct xdict_pattern {
+    int len;
+    int nsegs;
+    int seg[XDICT_MAXLENGTH+2];
+    uint32_t masks[XDICT_MAXLENGTH];
+    unsigned char lits[XDICT_MAXLENGTH];
+};
+
+
+/*
+   A cursor walks through the matches of a pattern a batch at a time,
+   so that the caller can page through a huge result set in bounded
+   memory. |xdict_cursor_open| returns the number of matches, or -1 if
+   the pattern is malformed (-3 if we run out of memory).
+   |xdict_cursor_next| copies up to |max| more matches into |words|
+   and returns how many it copied; zero means there are no more (and
+   -3 that we ran out of memory). |xdict_cursor_seek| moves to the
+   |n|th match (counting from zero), so that it is the next one
+   returned. Modifying the dictionary invalidates its open cursors.
+*/
+struct xdict_cursor {
+    struct xdict *d;
+    struct xdict_pattern pat;
+    int minscore;
+    int k, end;    /* the current length bucket, and one past the last */
+    size_t i;      /* the next word of bucket |k| to consider */
+    size_t pos;    /* the number of matches passed so far */
+    size_t total;  /* the number of matches */
 };
 
-struct word_entry {
-    char *word;
+
+/*
+   A small set of words of any length, for clients such as the filler
+   that need to spot repeats: |xdict_wordset_add| returns 1 if the word
+   was already in the set, 0 if it was added, or -3 if the set is full.
+   The set holds at most the |maxwords| and |maxchars| given to
+   |xdict_wordset_init|, which is the only call that allocates.
+*/
+struct xdict_wordset {
+    uint32_t *slots;  /* 0, or 1 + offset of the word in |text| */
+    size_t mask;
+    char *text;       /* each word is a length byte, then the word */
+    size_t textlen, textcap;
+    size_t len, maxwords;
 };
 
 
 void xdict_init(struct xdict *d);
 int xdict_load(struct xdict *d, const char *fname);
+  int xdict_open_mapped(struct xdict *d, const char *fname);
+  int xdict_replay_journal(struct xdict *d, const char *fname);
   int xdict_addword(struct xdict *d, const char *word, int len);
+  int xdict_addword_scored(struct xdict *d, const char *word, int len,
+                           int score);
   int xdict_remword(struct xdict *d, const char *word, int len);
   int xdict_remmatch(struct xdict *d, const char *pat, int len);
+  int xdict_remove_at(struct xdict *d, int len, size_t i);
+  int xdict_remove_if(struct xdict *d, int len,
+                      int (*f)(const char *, void *), void *info);
+  int xdict_remove_below(struct xdict *d, int minscore);
 void xdict_sort(struct xdict *d);
+int xdict_build_index(struct xdict *d, int which);
+  void xdict_set_threads(struct xdict *d, int n);
+  int xdict_set_cache(struct xdict *d, size_t maxbytes);
 int xdict_save(struct xdict *d, const char *fname);
+  int xdict_append_journal(const char *fname, int op, const char *text);
+int xdict_save_binary(struct xdict *d, const char *fname);
+int xdict_save_compressed(struct xdict *d, const char *fname);
 void xdict_free(struct xdict *d);
+int xdict_contains(struct xdict *d, const char *word, int len);
 int xdict_find(struct xdict *d, const char *pattern,
                int (*f)(const char *, void *), void *info);
+  int xdict_count(struct xdict *d, const char *pattern);
+  int xdict_find_many(struct xdict *d, const char *const *patterns, int n,
+                      int *counts,
+                      int (*f)(int, const char *, void *), void *info);
+  int xdict_find_min(struct xdict *d, const char *pattern, int minscore,
+                     int (*f)(const char *, void *), void *info);
+  int xdict_compile_pattern(struct xdict_pattern *pat, const char *pattern);
+  int xdict_find_pattern(struct xdict *d, const struct xdict_pattern *pat,
+                         int (*f)(const char *, void *), void *info);
+  int xdict_find_pattern_min(struct xdict *d, const struct xdict_pattern *pat,
+                             int minscore,
+                             int (*f)(const char *, void *), void *info);
+  int xdict_pattern_match(const struct xdict_pattern *pat,
+                          const char *w, size_t n);
   int xdict_match_simple(const char *w, const char *p);
   int xdict_match(const char *w, const char *p);
 int xdict_find_scrabble(struct xdict *d, const char *rack, const char *mustuse,
                         int (*f)(const char *, void *), void *info);
+int xdict_find_fuzzy(struct xdict *d, const char *word, int maxdist,
+                     int (*f)(const char *, void *), void *info);
+int xdict_find_letterset(struct xdict *d, const char *allowed,
+                         const char *required,
+                         int (*f)(const char *, void *), void *info);
+int xdict_find_ladder(struct xdict *d, const char *from, const char *to,
+                      int (*f)(const char *, void *), void *info);
+  int xdict_find_ladders(struct xdict *d, const char *from, const char *to,
+                         int maxsteps,
+                         int (*f)(const char *, void *), void *info);
+
+int xdict_cursor_open(struct xdict_cursor *c, struct xdict *d,
+                      const char *pattern, int minscore);
+  int xdict_cursor_next(struct xdict_cursor *c,
+                        char (*words)[XDICT_MAXLENGTH], int max);
+  int xdict_cursor_seek(struct xdict_cursor *c, size_t n);
+void xdict_cursor_close(struct xdict_cursor *c);
+
+int xdict_wordset_init(struct xdict_wordset *s, size_t maxwords, size_t maxchars);
+  void xdict_wordset_clear(struct xdict_wordset *s);
+  int xdict_wordset_add(struct xdict_wordset *s, const char *word, int len);
+  int xdict_wordset_contains(const struct xdict_wordset *s,
+                             const char *word, int len);
+void xdict_wordset_free(struct xdict_wordset *s);
 
 #ifdef __cplusplus
 } // extern "C"
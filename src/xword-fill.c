@@ -30,6 +30,7 @@ struct xword_info {
     const char *grid;
     struct dance_matrix *mat;
     FILE *out;
+    struct xdict_wordset *seen;  /* scratch for grid_contains_duplicates */
 };
 
 
@@ -38,6 +39,7 @@ static char *OutputFilename = NULL;
 static FILE *DebugFile = NULL;
 static int NumSolutions = -1; /* print all solutions by default */
 static int RejectDuplicateWords = 1;
+static int MinScore = 0;  /* ignore dictionary words scoring less */
 /* Pass "--naive" if you want to see the simple method in which
  * the matrix always has exactly 54*w*h columns.  In the default method, we
  * compress the matrix by getting rid of all the slices that correspond to
@@ -51,6 +53,10 @@ static int PrintEveryNthSolution = 1;
 int load_grid(FILE *fp, char **grid, int *w, int *h);
  void strip_space(char *line);
 void strip_dict(const char *grid, int w, int h, struct xdict *dict);
+ int useless_word(const char *word, void *info);
+int count_candidates(const char *grid, int w, int h, struct xdict *dict);
+ int entry_pattern(const char *grid, int w, int i, int j, int len,
+     int across, char *pattern);
 
 int xword_solve(const char *grid, int w, int h, struct xdict *dict,
     FILE *out);
@@ -72,7 +78,8 @@ int xword_solve(const char *grid, int w, int h, struct xdict *dict,
      int i, int j, const char *grid);
 
  int print_crossword_result(size_t n, struct data_object **sol, void *info);
-  int grid_contains_duplicates(const char *grid, int w, int h);
+  int grid_contains_duplicates(const char *grid, int w, int h,
+      struct xdict_wordset *seen);
 
 int is_fixed_value(int ch);
 
@@ -93,6 +100,7 @@ int main(int argc, char **argv)
     int i;
 
     xdict_init(&dict);
+    xdict_set_threads(&dict, 0);
 
     for (i=1; i < argc; ++i) {
         if (argv[i][0] != '-') break;
@@ -127,6 +135,10 @@ int main(int argc, char **argv)
             PrintEveryNthSolution = atoi(argv[++i]);
             if (PrintEveryNthSolution <= 0)
               do_error("Option --every expects a positive integer!");
+        } else if (steq(argv[i], "--min_score")) {
+            if (i >= argc-1)
+              do_error("Need a number (the lowest score) with --min_score");
+            MinScore = atoi(argv[++i]);
         } else if (steq(argv[i], "--allow_duplicate_words")) {
             RejectDuplicateWords = 0;
         } else if (steq(argv[i], "--debug")) {
@@ -163,9 +175,21 @@ int main(int argc, char **argv)
     if (gridfp != stdin)
       fclose(gridfp);
 
-    if (RejectDuplicateWords && grid_contains_duplicates(grid, gridw, gridh)) {
-        do_error("The input grid contains duplicate words!\n"
-                 "Use option --allow_duplicate_words, or amend your input file.");
+    if (RejectDuplicateWords) {
+        struct xdict_wordset seen;
+        int rc;
+        if (xdict_wordset_init(&seen, 2*gridw*gridh, 2*gridw*gridh) != 0)
+          do_error("Out of memory loading grid!");
+        rc = grid_contains_duplicates(grid, gridw, gridh, &seen);
+        if (rc == 1) {
+            do_error("The input grid contains duplicate words!\n"
+                     "Use option --allow_duplicate_words, or amend your input file.");
+        }
+        else if (rc == -1)
+          do_error("The input grid has an entry too long to check!");
+        else if (rc != 0)
+          do_error("Out of memory checking for duplicate words!");
+        xdict_wordset_free(&seen);
     }
     debug("Done checking for duplicate words in input grid.");
 
@@ -184,7 +208,10 @@ int main(int argc, char **argv)
 
     strip_dict(grid, gridw, gridh, &dict);
 
-    xword_solve(grid, gridw, gridh, &dict, outfp);
+    if (count_candidates(grid, gridw, gridh, &dict) > 0)
+      printf("There were 0 solutions found.\n");
+    else if (xword_solve(grid, gridw, gridh, &dict, outfp) != 0)
+      do_error("Out of memory setting up the solver!");
 
     xdict_free(&dict);
 
@@ -394,14 +421,25 @@ static int CELL_TO_SLICE(int cell, struct xword_info *info)
 int xword_solve(const char *grid, int w, int h, struct xdict *dict, FILE *out)
 {
     struct dance_matrix mat;
+    struct xdict_wordset seen;
     int ns;
     int i,j;
     /* Set up the info for our callback grid-printing function. */
-    struct xword_info info = { w, h, grid, &mat, out };
+    struct xword_info info = { w, h, grid, &mat, out, NULL };
     int cols = 27*2*NUMBER_OF_SLICES(&info);
-    int rc = dance_init(&mat, 0, cols, NULL);
-    if (rc != 0)
-      return rc;
+    int rc;
+    if (RejectDuplicateWords) {
+        rc = xdict_wordset_init(&seen, 2*w*h, 2*w*h);
+        if (rc != 0)
+          return rc;
+        info.seen = &seen;
+    }
+    rc = dance_init(&mat, 0, cols, NULL);
+    if (rc != 0) {
+        if (info.seen != NULL)
+          xdict_wordset_free(info.seen);
+        return rc;
+    }
 
     xdict_find(dict, "*", add_rows_for_word, &info);
 
@@ -481,6 +519,8 @@ int xword_solve(const char *grid, int w, int h, struct xdict *dict, FILE *out)
     }
 
     dance_free(&mat);
+    if (info.seen != NULL)
+      xdict_wordset_free(info.seen);
     return 0;
 }
 
@@ -772,7 +812,7 @@ int print_crossword_result(size_t n, struct data_object **sol, void *vinfo)
     }
 
     if (RejectDuplicateWords) {
-        int rc = grid_contains_duplicates(grid, w, h);
+        int rc = grid_contains_duplicates(grid, w, h, info->seen);
         if (rc < 0) {
             debug("grid_contains_duplicates() returned %d", rc);
             free(grid);
@@ -827,16 +867,6 @@ void strip_space(char *buf)
 }
 
 
-/* Compare two strings lexicographically. */
-int ptr_str_cmp(const void *vp, const void *vq)
-{
-    char * const *a = vp;
-    char * const *b = vq;
-    int k = strcmp(*a, *b);
-    return (k < 0)? -1: (k > 0);
-}
-
-
 
 /*
     This routine strips out all the "useless" words from the dictionary
@@ -845,74 +875,186 @@ int ptr_str_cmp(const void *vp, const void *vq)
     we only care about one or two problem corners.
 
     This routine also strips out any words that appear in the grid
-    already, so that we don't duplicate any words.
+    already, so that we don't duplicate any words, and (with option
+    --min_score) any words whose score is too low.
 */
 void strip_dict(const char *grid, int w, int h, struct xdict *dict)
 {
+    struct xword_info info;
     int k;
-    size_t widx;
-    int i, j;
     int removed_count = 0;
 
-    for (k=0; k < XDICT_MAXLENGTH; ++k) {
-        for (widx=0; widx < dict->len[k]; ++widx) {
-            char *word = dict->words[k][widx].word;
-            int fits_in_grid = 0;
-
-            /* Does the current |word| fit in the grid? */
-            for (j=0; j < h; ++j) {
-                for (i=0; i < w-k+1; ++i) {
-                    switch (entry_fits_across(grid, w, h, i, j, word, k)) {
-                        case 2: if (RejectDuplicateWords) goto remove_it;
-                        case 1: fits_in_grid = 1;
-                          if (!RejectDuplicateWords) goto next;
-                    }
-                }
+    if (MinScore > 0) {
+        int rc = xdict_remove_below(dict, MinScore);
+        if (rc < 0)
+          do_error("Out of memory stripping dictionary!");
+        debug("Removed %d words scoring less than %d.", rc, MinScore);
+    }
+
+    info.w = w;
+    info.h = h;
+    info.grid = grid;
+    for (k=0; k < XDICT_MAXLENGTH; ++k)
+      removed_count += xdict_remove_if(dict, k, useless_word, &info);
+
+    debug("Preemptively removed %d already-used or useless words\n"
+          " from the dictionary, leaving %d.", removed_count, dict_len(dict));
+    return;
+}
+
+
+/*
+   Does |word| not fit anywhere in the grid, or (unless we allow
+   duplicates) is it already there?
+*/
+int useless_word(const char *word, void *info)
+{
+    struct xword_info *xi = info;
+    const char *grid = xi->grid;
+    int w = xi->w, h = xi->h;
+    int k = strlen(word);
+    int i, j;
+    int fits_in_grid = 0;
+
+    for (j=0; j < h; ++j) {
+        for (i=0; i < w-k+1; ++i) {
+            switch (entry_fits_across(grid, w, h, i, j, word, k)) {
+                case 2: if (RejectDuplicateWords) return 1;
+                case 1: fits_in_grid = 1;
+                  if (!RejectDuplicateWords) return 0;
             }
-            for (j=0; j < h-k+1; ++j) {
-                for (i=0; i < w; ++i) {
-                    switch (entry_fits_down(grid, w, h, i, j, word, k)) {
-                        case 2: if (RejectDuplicateWords) goto remove_it;
-                        case 1: fits_in_grid = 1;
-                          if (!RejectDuplicateWords) goto next;
-                    }
-                }
+        }
+    }
+    for (j=0; j < h-k+1; ++j) {
+        for (i=0; i < w; ++i) {
+            switch (entry_fits_down(grid, w, h, i, j, word, k)) {
+                case 2: if (RejectDuplicateWords) return 1;
+                case 1: fits_in_grid = 1;
+                  if (!RejectDuplicateWords) return 0;
             }
+        }
+    }
+    return !fits_in_grid;
+}
+
 
-            /* It doesn't fit, or is duplicated. Remove it. */
-            if (!fits_in_grid) {
-              remove_it:
-                free(word);
-                dict->words[k][widx] = dict->words[k][--dict->len[k]];
-                removed_count += 1;
+/*
+   Before building the matrix, count the dictionary words that could
+   go in each entry of the grid. |xdict_find_many| counts them all in
+   a single pass over the dictionary, so this is cheap, and it catches
+   a hopeless grid early: if no word fits some open entry, there can
+   be no solutions at all. Return the number of such entries.
+*/
+struct grid_entry {
+    int i, j, across;
+    char pattern[MAX_WORDLEN+1];
+};
+
+int count_candidates(const char *grid, int w, int h, struct xdict *dict)
+{
+    struct grid_entry *entries = malloc(w*h * sizeof *entries);
+    const char **patterns = malloc(w*h * sizeof *patterns);
+    int *counts = malloc(w*h * sizeof *counts);
+    int n = 0, hopeless = 0;
+    int i, j;
+
+    if (entries == NULL || patterns == NULL || counts == NULL)
+      do_error("Out of memory counting candidates!");
+    for (j=0; j < h; ++j) {
+        int start = 0;
+        for (i=0; i <= w; ++i) {
+            if (i < w && grid[j*w+i] != '#') continue;
+            if (i - start >= 2 &&
+                entry_pattern(grid, w, start, j, i - start, 1, entries[n].pattern)) {
+                entries[n].i = start;
+                entries[n].j = j;
+                entries[n++].across = 1;
+            }
+            start = i+1;
+        }
+    }
+    for (i=0; i < w; ++i) {
+        int start = 0;
+        for (j=0; j <= h; ++j) {
+            if (j < h && grid[j*w+i] != '#') continue;
+            if (j - start >= 2 &&
+                entry_pattern(grid, w, i, start, j - start, 0, entries[n].pattern)) {
+                entries[n].i = i;
+                entries[n].j = start;
+                entries[n++].across = 0;
             }
-          next:
-            /* Go get the next word in the dictionary. */
-            ;
+            start = j+1;
         }
     }
 
-    debug("Preemptively removed %d already-used or useless words\n"
-          " from the dictionary, leaving %d.", removed_count, dict_len(dict));
-    return;
+    for (i=0; i < n; ++i)
+      patterns[i] = entries[i].pattern;
+    if (xdict_find_many(dict, patterns, n, counts, NULL, NULL) != 0)
+      do_error("Out of memory counting candidates!");
+    for (i=0; i < n; ++i) {
+        const struct grid_entry *e = &entries[i];
+        debug("%d candidate%s for %s(%d,%d) %s", counts[i],
+              (counts[i]==1)? "": "s", e->across? "across": "down",
+              e->i, e->j, e->pattern);
+        if (counts[i] == 0) {
+            printf("No word in the dictionary fits %s(%d,%d) %s.\n",
+                e->across? "across": "down", e->i, e->j, e->pattern);
+            ++hopeless;
+        }
+    }
+    free(entries);
+    free(patterns);
+    free(counts);
+    return hopeless;
+}
+
+
+/*
+   Spell out the entry of |len| cells starting at (i,j) as a pattern,
+   and return 1; or return 0 if it is already filled in (or too long).
+*/
+int entry_pattern(const char *grid, int w, int i, int j, int len,
+    int across, char *pattern)
+{
+    int open = 0;
+    int k;
+
+    if (len > MAX_WORDLEN) return 0;
+    for (k=0; k < len; ++k) {
+        int ch = across? grid[j*w+(i+k)]: grid[(j+k)*w+i];
+        if (ch == '.')
+          pattern[k] = '?', open = 1;
+        else if (ch == '0' || ch == '1')
+          pattern[k] = ch, open = 1;
+        else if (islower(ch))
+          pattern[k] = ch;
+        else
+          return 0;
+    }
+    pattern[len] = '\0';
+    return open;
 }
 
 
-/* Returns 1 if the grid contains duplicates; 0 if it doesn't;
- * or -3 if we run out of memory. */
-int grid_contains_duplicates(const char *grid, int w, int h)
+/*
+   Collect the complete entries of |grid| into the word set |seen|,
+   stopping at the first one that is already there. Returns 1 if the
+   grid contains duplicates; 0 if it doesn't; -1 if an entry is 256
+   or more letters long; or -3 if |seen| runs out of room.
+*/
+int grid_contains_duplicates(const char *grid, int w, int h,
+    struct xdict_wordset *seen)
 {
-    char **dict = malloc(2*w*h * sizeof *dict);
-    int len = 0;
-    int rc = 0;
+    char entry[256];
     int i, j, k, end;
 
-    if (dict == NULL) return -3;
+    xdict_wordset_clear(seen);
 
     /* Insert the "Across" entries. */
     for (j=0; j < h; ++j) {
         for (i=0; i < w; i = end) {
             int invalid = 0;
+            int rc;
             end = i+1;
             if (grid[j*w+i]=='#') continue;
             for (end=i; end < w; ++end) {
@@ -920,14 +1062,14 @@ int grid_contains_duplicates(const char *grid, int w, int h)
                 if (strchr(".01", grid[j*w+end])) invalid = 1;
             }
             if (invalid) continue;
-            if ((dict[len] = malloc(end-i+1)) == NULL) {
-                rc = -3;
-                break;
-            }
+            if (end-i >= (int)sizeof entry) return -1;
             for (k=0; k < end-i; ++k)
-              dict[len][k] = tolower(grid[j*w+(i+k)]);
-            dict[len][k] = '\0';
-            len += 1;
+              entry[k] = tolower(grid[j*w+(i+k)]);
+            entry[k] = '\0';
+            if ((rc = xdict_wordset_add(seen, entry, k)) != 0) {
+                if (rc == 1) debug("The duplicate word is '%s'.", entry);
+                return rc;
+            }
         }
     }
 
@@ -935,6 +1077,7 @@ int grid_contains_duplicates(const char *grid, int w, int h)
     for (i=0; i < w; ++i) {
         for (j=0; j < h; j = end) {
             int invalid = 0;
+            int rc;
             end = j+1;
             if (grid[j*w+i]=='#') continue;
             for (end=j; end < h; ++end) {
@@ -942,29 +1085,17 @@ int grid_contains_duplicates(const char *grid, int w, int h)
                 if (strchr(".01", grid[end*w+i])) invalid = 1;
             }
             if (invalid) continue;
-            if ((dict[len] = malloc(end-j+1)) == NULL) {
-                rc = -3;
-                break;
-            }
+            if (end-j >= (int)sizeof entry) return -1;
             for (k=0; k < end-j; ++k)
-              dict[len][k] = tolower(grid[(j+k)*w+i]);
-            dict[len][k] = '\0';
-            len += 1;
-        }
-    }
-
-    qsort(dict, len, sizeof *dict, ptr_str_cmp);
-    for (k=0; k < len-1; ++k) {
-        if (strcmp(dict[k], dict[k+1]) == 0) {
-            debug("The duplicate word is '%s'.", dict[k]);
-            rc = 1;
-            break;
+              entry[k] = tolower(grid[(j+k)*w+i]);
+            entry[k] = '\0';
+            if ((rc = xdict_wordset_add(seen, entry, k)) != 0) {
+                if (rc == 1) debug("The duplicate word is '%s'.", entry);
+                return rc;
+            }
         }
     }
-    for (k=0; k < len; ++k)
-      free(dict[k]);
-    free(dict);
-    return rc;
+    return 0;
 }
 
 
@@ -1011,7 +1142,8 @@ void do_help(int man)
     puts("Fills a crossword grid by constraint satisfaction.");
     puts("  --allow_duplicate_words: allow duplicate words in output grid");
     puts("  -n int: limit output to first 'n' valid grids");
-    puts("  -d filename: load dictionary from specified file");
+    puts("  --min_score int: use only dictionary words scoring at least 'int'");
+    puts("  -d filename: load dictionary (text or xdict-compile'd) from file");
     puts("  -o filename: send output to specified file");
     puts("  --debug: dump debugging output to stderr");
     puts("  --help: show this message");
@@ -1028,6 +1160,10 @@ void do_help(int man)
     puts("   numerals 0 and 1, which stand for \"any vowel\" and \"any");
     puts("   consonant,\" respectively. Any other characters are treated");
     puts("   as the letter X when it comes to grid-filling.");
+    puts(" Before filling, the program counts the dictionary words that");
+    puts("   fit each entry of the grid (see --debug). If no word fits");
+    puts("   some entry, it reports that the grid has no solutions");
+    puts("   without trying to fill it.");
     puts(" The program transforms the input grid and dictionary into");
     puts("   a very large matrix of ones and zeros, and then looks for");
     puts("   an \"exact cover\" of this matrix: a set of rows such that");
@@ -1038,7 +1174,11 @@ void do_help(int man)
     puts("   crossword puzzle and prints out the solved grid.");
     puts(" Finding an exact cover can take a long time if the matrix is");
     puts("   large. If you find the program too slow, try giving it");
-    puts("   only one corner to fill at a time.");
+    puts("   only one corner to fill at a time, or raise --min_score.");
+    puts(" A dictionary line may give the word's score after a semicolon,");
+    puts("   as in \"aardvark;60\"; words without one score 50. With");
+    puts("   --min_score, lower-scoring words are dropped before the");
+    puts("   matrix is built, so they never appear in the fill.");
     puts(" Also remember that if your grid has two independent open");
     puts("   corners, with N and M distinct solutions respectively,");
     puts("   then passing the two-corner problem to 'xword-fill' will");
@@ -0,0 +1,278 @@
+/*
+   |Xword-scrabble| lists the legal Scrabble moves for one or more
+   positions, best first, using the move generator in scrabble.c.
+
+     The input is a series of positions, each one being 15 lines of
+   15 characters giving the board ('.' for an empty square, a lowercase
+   letter for a tile, an uppercase letter for a blank) followed by a
+   line giving the rack ('?' for a blank). Blank lines and lines
+   beginning with '#' are ignored. The dictionary is loaded and its
+   lexicon built only once, however many positions there are.
+
+     The dictionary has no two-letter words, which most parallel plays
+   need; give them with -w, in a file of one word per line.
+*/
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scrabble.h"
+#include "xdictlib.h"
+
+#define steq(s,t) (!strcmp(s,t))
+
+struct move_list {
+    struct scrabble_move *moves;
+    size_t len, cap;
+};
+
+static char *DictFilename = "xdict.save.txt";
+static char *ShortFilename = NULL;
+static int NumMoves = -1;  /* print all the moves by default */
+
+char **read_words(const char *fname, size_t *n);
+int read_position(FILE *fp, char *board, char *rack, int *lineno);
+ int read_line(FILE *fp, char *buf, int len, int *lineno);
+int collect_move(const struct scrabble_move *mv, void *info);
+int compare_moves(const void *p, const void *q);
+void print_move(const struct scrabble_move *mv, FILE *out);
+
+void do_error(const char *fmat, ...);
+void do_help(void);
+
+
+int main(int argc, char **argv)
+{
+    struct xdict dict;
+    struct scrabble_lexicon lex;
+    struct move_list list = { NULL, 0, 0 };
+    char board[SCRABBLE_SIZE*SCRABBLE_SIZE];
+    char rack[SCRABBLE_RACK+2];
+    char **extra = NULL;
+    size_t nextra = 0;
+    FILE *fp = stdin;
+    int lineno = 0;
+    int i, rc;
+
+    for (i=1; i < argc; ++i) {
+        if (argv[i][0] != '-' || argv[i][1] == '\0') break;
+        if (steq(argv[i], "--help") || steq(argv[i], "-h") ||
+                steq(argv[i], "-?")) {
+            do_help();
+        } else if (steq(argv[i], "-d")) {
+            if (i >= argc-1)
+              do_error("Need dictionary filename with -d");
+            DictFilename = argv[++i];
+        } else if (steq(argv[i], "-w")) {
+            if (i >= argc-1)
+              do_error("Need word list filename with -w");
+            ShortFilename = argv[++i];
+        } else if (steq(argv[i], "-n")) {
+            if (i >= argc-1)
+              do_error("Need a number (of moves) with -n");
+            NumMoves = atoi(argv[++i]);
+            if (NumMoves <= 0)
+              do_error("Option -n expects a positive integer!");
+        } else {
+            do_error("Unrecognized option(s) '%s'; -h for help", argv[i]);
+        }
+    }
+    if (argc-i > 1)
+      do_error("I can only read one input file at a time.");
+    if (i < argc && !steq(argv[i], "-")) {
+        fp = fopen(argv[i], "r");
+        if (fp == NULL)
+          do_error("I couldn't open position file '%s'!", argv[i]);
+    }
+
+    xdict_init(&dict);
+    xdict_set_threads(&dict, 0);
+    if (xdict_load(&dict, DictFilename) < 0)
+      do_error("Error loading dictionary file '%s'!", DictFilename);
+    if (ShortFilename != NULL) {
+        extra = read_words(ShortFilename, &nextra);
+        if (extra == NULL)
+          do_error("Error loading word list '%s'!", ShortFilename);
+    }
+    if (scrabble_lexicon_init(&lex, &dict, (const char *const *)extra, nextra) != 0)
+      do_error("Out of memory building the lexicon!");
+    for (i=0; (size_t)i < nextra; ++i)
+      free(extra[i]);
+    free(extra);
+
+    while ((rc = read_position(fp, board, rack, &lineno)) == 0) {
+        size_t n;
+        list.len = 0;
+        rc = scrabble_generate(&lex, board, rack, collect_move, &list);
+        if (rc == -1)
+          do_error("Bad board or rack ending on line %d!", lineno);
+        if (rc < 0 || list.len != (size_t)rc)
+          do_error("Out of memory generating moves!");
+        qsort(list.moves, list.len, sizeof *list.moves, compare_moves);
+        printf("Rack %s: %d move%s\n", rack, rc, &"s"[rc == 1]);
+        n = list.len;
+        if (NumMoves > 0 && (size_t)NumMoves < n) n = NumMoves;
+        for (i=0; (size_t)i < n; ++i)
+          print_move(&list.moves[i], stdout);
+    }
+    if (rc == -2)
+      do_error("Incomplete position ending on line %d!", lineno);
+
+    if (fp != stdin)
+      fclose(fp);
+    free(list.moves);
+    scrabble_lexicon_free(&lex);
+    xdict_free(&dict);
+    return 0;
+}
+
+
+/*
+   Read the words of |fname|, one per line, into an array of strings.
+   Return it, or NULL if the file can't be read or we run out of memory.
+*/
+char **read_words(const char *fname, size_t *n)
+{
+    FILE *fp = fopen(fname, "r");
+    char **words = NULL;
+    size_t cap = 0;
+    char buf[100];
+    int lineno = 0;
+    int len;
+    *n = 0;
+    if (fp == NULL) return NULL;
+    while ((len = read_line(fp, buf, sizeof buf, &lineno)) >= 0) {
+        if (*n == cap) {
+            void *t = realloc(words, (2*cap + 64) * sizeof *words);
+            if (t == NULL) break;
+            words = t;
+            cap = 2*cap + 64;
+        }
+        words[*n] = malloc(len+1);
+        if (words[*n] == NULL) break;
+        strcpy(words[*n], buf);
+        *n += 1;
+    }
+    fclose(fp);
+    if (len >= 0 || words == NULL) {
+        while (*n > 0) free(words[--*n]);
+        free(words);
+        return NULL;
+    }
+    return words;
+}
+
+/*
+   Read the next non-blank, non-comment line into |buf|, without its
+   newline. Return its length, or -1 at end of file.
+*/
+int read_line(FILE *fp, char *buf, int len, int *lineno)
+{
+    int n;
+    do {
+        if (fgets(buf, len, fp) == NULL) return -1;
+        *lineno += 1;
+        for (n = strlen(buf); n > 0 && isspace((unsigned char)buf[n-1]); --n) ;
+        buf[n] = '\0';
+    } while (n == 0 || buf[0] == '#');
+    return n;
+}
+
+/*
+   Return 0 if a position was read, -1 at the end of the input, or -2
+   if the input ends partway through a position or a line is the wrong
+   length.
+*/
+int read_position(FILE *fp, char *board, char *rack, int *lineno)
+{
+    char buf[100];
+    int r;
+    for (r=0; r < SCRABBLE_SIZE; ++r) {
+        int n = read_line(fp, buf, sizeof buf, lineno);
+        if (n < 0) return (r == 0)? -1: -2;
+        if (n != SCRABBLE_SIZE) return -2;
+        memcpy(board + r*SCRABBLE_SIZE, buf, SCRABBLE_SIZE);
+    }
+    if (read_line(fp, buf, sizeof buf, lineno) < 0) return -2;
+    if (strlen(buf) > SCRABBLE_RACK) return -2;
+    strcpy(rack, buf);
+    return 0;
+}
+
+
+int collect_move(const struct scrabble_move *mv, void *info)
+{
+    struct move_list *list = info;
+    if (list->len == list->cap) {
+        size_t newcap = 2*list->cap + 64;
+        void *t = realloc(list->moves, newcap * sizeof *list->moves);
+        if (t == NULL) return 1;
+        list->moves = t;
+        list->cap = newcap;
+    }
+    list->moves[list->len++] = *mv;
+    return 0;
+}
+
+/* Best first; ties in board order, so that the output is repeatable. */
+int compare_moves(const void *p, const void *q)
+{
+    const struct scrabble_move *a = p, *b = q;
+    if (a->score != b->score) return b->score - a->score;
+    if (a->row != b->row) return a->row - b->row;
+    if (a->col != b->col) return a->col - b->col;
+    if (a->across != b->across) return b->across - a->across;
+    return strcmp(a->word, b->word);
+}
+
+/*
+   Across moves are labeled row first ("8H"), and down moves column
+   first ("H8"). Letters already on the board are in parentheses.
+*/
+void print_move(const struct scrabble_move *mv, FILE *out)
+{
+    char coord[32];
+    int i, open = 0;
+    if (mv->across)
+      sprintf(coord, "%d%c", mv->row+1, 'A' + mv->col);
+    else
+      sprintf(coord, "%c%d", 'A' + mv->col, mv->row+1);
+    fprintf(out, "%4d  %-4s ", mv->score, coord);
+    for (i=0; mv->word[i] != '\0'; ++i) {
+        int fresh = (mv->placed >> i) & 1;
+        if (!fresh && !open) putc('(', out), open = 1;
+        if (fresh && open) putc(')', out), open = 0;
+        putc(mv->word[i], out);
+    }
+    if (open) putc(')', out);
+    putc('\n', out);
+}
+
+
+void do_error(const char *fmat, ...)
+{
+    va_list ap;
+    printf("xword-scrabble: ");
+    va_start(ap, fmat);
+    vprintf(fmat, ap);
+    printf("\n");
+    va_end(ap);
+    exit(EXIT_FAILURE);
+}
+
+
+void do_help(void)
+{
+    puts("xword-scrabble [-?h] [-d dictfile] [-w wordfile] [-n N] [positionfile]");
+    puts("Lists the legal Scrabble moves for each position, best first.");
+    puts("  -d: dictionary to use (default xdict.save.txt)");
+    puts("  -w: more words, one per line, such as the two-letter words");
+    puts("  -n: list only the best N moves of each position");
+    puts("  positionfile: one or more positions, each 15 lines of 15");
+    puts("      characters ('.' empty, 'a' a tile, 'A' a blank) and");
+    puts("      then a line with the rack ('?' a blank); default stdin");
+    puts("  --help: show this message");
+    exit(0);
+}
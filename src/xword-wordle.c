@@ -0,0 +1,196 @@
+/*
+   |Xword-wordle| suggests Wordle guesses. It reads the game so far,
+   one guess per line followed by its feedback ("crane ..gy."), and
+   after each line prints the answers still possible and the guesses
+   that promise the most information about which one it is.
+
+     The answers come from the targets file; the guesses may also
+   include the five-letter words of a second, larger dictionary, given
+   with -g. Lines beginning with '#' are ignored.
+*/
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wordle.h"
+#include "xdictlib.h"
+
+#define steq(s,t) (!strcmp(s,t))
+
+static char *TargetFilename = "wordle-targets.txt";
+static char *GuessFilename = NULL;
+static int NumGuesses = 10;
+static int NumShown = 20;   /* list the answers when this few remain */
+static int NumThreads = 0;  /* one per processor */
+
+void report(const struct wordle *w, const size_t *remaining, size_t n,
+            struct wordle_rank *ranks);
+
+void do_error(const char *fmat, ...);
+void do_help(void);
+
+
+int main(int argc, char **argv)
+{
+    struct xdict targets, guesses;
+    struct wordle w;
+    struct wordle_constraint c;
+    struct wordle_rank *ranks;
+    size_t *remaining;
+    size_t n;
+    FILE *fp = stdin;
+    char buf[100];
+    int lineno = 0;
+    int i, rc;
+
+    for (i=1; i < argc; ++i) {
+        if (argv[i][0] != '-' || argv[i][1] == '\0') break;
+        if (steq(argv[i], "--help") || steq(argv[i], "-h") ||
+                steq(argv[i], "-?")) {
+            do_help();
+        } else if (steq(argv[i], "-t")) {
+            if (i >= argc-1)
+              do_error("Need targets filename with -t");
+            TargetFilename = argv[++i];
+        } else if (steq(argv[i], "-g")) {
+            if (i >= argc-1)
+              do_error("Need guesses filename with -g");
+            GuessFilename = argv[++i];
+        } else if (steq(argv[i], "-n")) {
+            if (i >= argc-1)
+              do_error("Need a number (of guesses) with -n");
+            NumGuesses = atoi(argv[++i]);
+            if (NumGuesses <= 0)
+              do_error("Option -n expects a positive integer!");
+        } else if (steq(argv[i], "-j")) {
+            if (i >= argc-1)
+              do_error("Need a number (of threads) with -j");
+            NumThreads = atoi(argv[++i]);
+            if (NumThreads <= 0)
+              do_error("Option -j expects a positive integer!");
+        } else {
+            do_error("Unrecognized option(s) '%s'; -h for help", argv[i]);
+        }
+    }
+    if (argc-i > 1)
+      do_error("I can only read one input file at a time.");
+    if (i < argc && !steq(argv[i], "-")) {
+        fp = fopen(argv[i], "r");
+        if (fp == NULL)
+          do_error("I couldn't open game file '%s'!", argv[i]);
+    }
+
+    xdict_init(&targets);
+    if (xdict_load(&targets, TargetFilename) < 0)
+      do_error("Error loading targets file '%s'!", TargetFilename);
+    xdict_build_index(&targets, XDICT_INDEX_HASH);
+    xdict_init(&guesses);
+    if (GuessFilename != NULL && xdict_load(&guesses, GuessFilename) < 0)
+      do_error("Error loading guesses file '%s'!", GuessFilename);
+    rc = wordle_init(&w, &targets, (GuessFilename != NULL)? &guesses: NULL,
+                     NumThreads);
+    if (rc == -1)
+      do_error("There are no five-letter words in '%s'!", TargetFilename);
+    if (rc != 0)
+      do_error("Out of memory building the feedback table!");
+    xdict_free(&guesses);
+    xdict_free(&targets);
+
+    remaining = malloc(w.ntargets * sizeof *remaining);
+    ranks = malloc(w.nwords * sizeof *ranks);
+    if (remaining == NULL || ranks == NULL)
+      do_error("Out of memory!");
+
+    wordle_constraint_init(&c);
+    n = wordle_filter(&w, &c, remaining);
+    report(&w, remaining, n, ranks);
+
+    while (fgets(buf, sizeof buf, fp) != NULL) {
+        char guess[sizeof buf], fb[sizeof buf];
+        int code;
+        ++lineno;
+        if (buf[0] == '#') continue;
+        if (sscanf(buf, "%s %s", guess, fb) != 2) {
+            if (sscanf(buf, "%s", guess) != 1) continue;
+            do_error("Line %d: expected a guess and its feedback!", lineno);
+        }
+        for (i=0; guess[i] != '\0'; ++i)
+          guess[i] = tolower((unsigned char)guess[i]);
+        code = wordle_parse_feedback(fb);
+        if (code < 0)
+          do_error("Line %d: feedback '%s' should be five of 'g', 'y', '.'!",
+                   lineno, fb);
+        if (strlen(guess) != WORDLE_LENGTH || wordle_constrain(&c, guess, code) != 0)
+          do_error("Line %d: guess '%s' should be five letters!", lineno, guess);
+        n = wordle_filter(&w, &c, remaining);
+        printf("\nAfter %s %s: ", guess, fb);
+        report(&w, remaining, n, ranks);
+    }
+
+    if (fp != stdin)
+      fclose(fp);
+    free(ranks);
+    free(remaining);
+    wordle_free(&w);
+    return 0;
+}
+
+
+/*
+   Print how many answers remain (and what they are, if there are few
+   enough), and then the best guesses, marking with '*' those that
+   could win outright.
+*/
+void report(const struct wordle *w, const size_t *remaining, size_t n,
+            struct wordle_rank *ranks)
+{
+    size_t i;
+    if (n == 0) {
+        printf("no answer fits!\n");
+        return;
+    }
+    if (n == 1) {
+        printf("the answer is %s.\n", w->words[remaining[0]]);
+        return;
+    }
+    printf("%lu possible answers\n", (unsigned long)n);
+    if (n <= (size_t)NumShown) {
+        for (i=0; i < n; ++i)
+          printf("%s%s", (i == 0)? "  ": " ", w->words[remaining[i]]);
+        printf("\n");
+    }
+    wordle_rank(w, remaining, n, ranks);
+    for (i=0; i < w->nwords && i < (size_t)NumGuesses; ++i) {
+        printf("%8.3f  %s%s\n", ranks[i].entropy, w->words[ranks[i].guess],
+               ranks[i].candidate? " *": "");
+    }
+}
+
+
+void do_error(const char *fmat, ...)
+{
+    va_list ap;
+    printf("xword-wordle: ");
+    va_start(ap, fmat);
+    vprintf(fmat, ap);
+    printf("\n");
+    va_end(ap);
+    exit(EXIT_FAILURE);
+}
+
+
+void do_help(void)
+{
+    puts("xword-wordle [-?h] [-t targets] [-g guesses] [-n N] [-j N] [gamefile]");
+    puts("Suggests the guesses that tell the most about a Wordle answer.");
+    puts("  -t: the possible answers (default wordle-targets.txt)");
+    puts("  -g: more words that may be guessed but are never the answer");
+    puts("  -n: list the best N guesses (default 10)");
+    puts("  -j: use N threads (default one per processor)");
+    puts("  gamefile: the guesses so far, one per line, each followed by");
+    puts("      its feedback: 'g' green, 'y' yellow, '.' gray; default stdin");
+    puts("  --help: show this message");
+    exit(0);
+}